@@ -0,0 +1,67 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <queue>
+
+/**
+ * Blocking fifo queue with a fixed capacity for pipelines: a fast producer waits for the consumer instead of
+ * buffering everything. close() ends the pipeline, it wakes all waiting threads.
+ */
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : m_Capacity(std::max<size_t>(1, capacity)) {
+    }
+
+    /**
+     * Waits while the queue is full.
+     * @return false if the queue was closed, the value is dropped then
+     */
+    bool push(T value) {
+        std::unique_lock lock{m_Mutex};
+        m_NotFull.wait(lock, [this] { return m_Closed || m_Queue.size() < m_Capacity; });
+        if (m_Closed) return false;
+        m_Queue.push(std::move(value));
+        m_NotEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * Waits while the queue is empty.
+     * @return std::nullopt if the queue is closed and empty
+     */
+    std::optional<T> pop() {
+        std::unique_lock lock{m_Mutex};
+        m_NotEmpty.wait(lock, [this] { return m_Closed || !m_Queue.empty(); });
+        if (m_Queue.empty()) return std::nullopt;
+        T value = std::move(m_Queue.front());
+        m_Queue.pop();
+        m_NotFull.notify_one();
+        return value;
+    }
+
+    /**
+     * push() fails from now on, pop() still returns the queued values.
+     */
+    void close() {
+        std::lock_guard guard{m_Mutex};
+        m_Closed = true;
+        m_NotFull.notify_all();
+        m_NotEmpty.notify_all();
+    }
+
+private:
+    std::queue<T> m_Queue;
+    size_t m_Capacity;
+    bool m_Closed = false;
+    std::mutex m_Mutex;
+    std::condition_variable m_NotFull;
+    std::condition_variable m_NotEmpty;
+};
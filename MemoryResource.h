@@ -7,6 +7,7 @@
 #include <iostream>
 #include <istream>
 #include <memory>
+#include <span>
 #include <vector>
 #include <fstream>
 
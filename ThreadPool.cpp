@@ -0,0 +1,77 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <atomic>
+#include <memory>
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        m_Workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard guard{m_Mutex};
+        m_ShouldStop = true;
+    }
+    m_Condition.notify_all();
+    for (auto &worker: m_Workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard guard{m_Mutex};
+        m_Tasks.emplace(std::move(task));
+    }
+    m_Condition.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock{m_Mutex};
+            m_Condition.wait(lock, [this] { return m_ShouldStop || !m_Tasks.empty(); });
+            if (m_Tasks.empty()) return;
+            task = std::move(m_Tasks.front());
+            m_Tasks.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t)> &fun) {
+    if (count == 0) return;
+    // Shared with the helper tasks since they may only start after this call returned
+    struct State {
+        std::function<void(uint32_t)> fun;
+        uint32_t count;
+        std::atomic_uint32_t next = 0;
+        std::atomic_uint32_t done = 0;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto state = std::make_shared<State>(fun, count);
+    auto work = [state] {
+        uint32_t i;
+        while ((i = state->next++) < state->count) {
+            state->fun(i);
+            if (++state->done == state->count) {
+                std::lock_guard guard{state->mutex};
+                state->finished.notify_all();
+            }
+        }
+    };
+    uint32_t helpers = std::min<uint32_t>(count - 1, m_Workers.size());
+    for (uint32_t i = 0; i < helpers; ++i) {
+        submit(work);
+    }
+    work();
+    std::unique_lock lock{state->mutex};
+    state->finished.wait(lock, [&state] { return state->done == state->count; });
+}
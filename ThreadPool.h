@@ -0,0 +1,48 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed size pool of worker threads. parallelFor() may be called from inside a task, the calling thread always
+ * helps with the work so nested calls cannot starve the pool.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency()));
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> task);
+
+    /**
+     * Calls fun(i) for every i in [0, count) on the pool and the calling thread. Returns when all calls are done.
+     */
+    void parallelFor(uint32_t count, const std::function<void(uint32_t)> &fun);
+
+    [[nodiscard]] uint32_t getThreadCount() const {
+        return m_Workers.size();
+    }
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> m_Workers;
+    std::queue<std::function<void()>> m_Tasks;
+    std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    bool m_ShouldStop = false;
+};
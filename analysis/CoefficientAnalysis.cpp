@@ -0,0 +1,64 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <iostream>
+#include <memory>
+#include "CoefficientAnalysis.h"
+#include "../codec/DspADPCM.h"
+#include "../format/bfstm/BfstmBlocks.h"
+#include "../format/bfstm/BfstmFile.h"
+
+std::ostream &operator<<(std::ostream &os, const CoefficientFidelity &obj) {
+    os << "Channel " << obj.channel << " (max difference " << obj.maxDifference << ")\n";
+    for (int i = 0; i < 8; ++i) {
+        for (int k = 0; k < 2; ++k) {
+            os << "Coefficients Real[" << i << "][" << k << "] = " << obj.real[i][k] << " Calc[" << i << "][" << k
+               << "] = " << obj.estimated[k + i * 2] << '\n';
+        }
+    }
+    return os;
+}
+
+std::vector<CoefficientFidelity> analyzeCoefficients(const BfstmContext &context, const void *dataPtr) {
+    const auto &streamInfo = context.streamInfo;
+    std::vector<CoefficientFidelity> result;
+    if (streamInfo.soundEncoding != SoundEncoding::DSP_ADPCM || streamInfo.blockCountPerChannel == 0) {
+        std::cerr << "Coefficient analysis is only available for dsp-adpcm streams!" << std::endl;
+        return result;
+    }
+    uint32_t sampleCount = (streamInfo.blockCountPerChannel - 1) * streamInfo.blockSizeSamples +
+                           streamInfo.lastBlockSizeSamples;
+    auto pcm = std::make_unique_for_overwrite<int16_t[]>(sampleCount);
+
+    BfstmBlockRange blocks{context, dataPtr};
+    for (uint32_t ch = 0; ch < streamInfo.channelNum; ++ch) {
+        const auto &dsp = get<BfstmDSPADPCMChannelInfo>(context.channelInfos[ch]);
+        int16_t yn1 = dsp.startContext.yn1;
+        int16_t yn2 = dsp.startContext.yn2;
+        for (const BfstmBlock block: blocks) {
+            dspadpcm::decode(block.getChannelPtr(ch), pcm.get() + block.startSample, yn1, yn2, dsp.coefficients,
+                             block.sampleCount, 0);
+        }
+
+        CoefficientFidelity &fidelity = result.emplace_back();
+        fidelity.channel = ch;
+        fidelity.estimated = dspadpcm::calculateCoefficients(pcm.get(), sampleCount);
+        fidelity.maxDifference = 0;
+        for (int j = 0; j < 8; ++j) {
+            for (int k = 0; k < 2; ++k) {
+                fidelity.real[j][k] = dsp.coefficients[j][k];
+                int32_t diff = std::abs(fidelity.real[j][k] - fidelity.estimated[k + j * 2]);
+                fidelity.maxDifference = std::max(fidelity.maxDifference, diff);
+            }
+        }
+    }
+    return result;
+}
+
+std::future<std::vector<CoefficientFidelity>> analyzeCoefficientsAsync(const BfstmContext &context,
+                                                                       const void *dataPtr) {
+    return std::async(std::launch::async, [&context, dataPtr] {
+        return analyzeCoefficients(context, dataPtr);
+    });
+}
@@ -0,0 +1,40 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <future>
+#include <ostream>
+#include <vector>
+
+struct BfstmContext;
+
+/**
+ * Compares the dsp-adpcm coefficients stored in a stream with the coefficients the encoder would calculate from the
+ * decoded audio. This is a diagnostic for the encoder and never runs during playback.
+ */
+struct CoefficientFidelity {
+    uint32_t channel;
+    int16_t real[8][2];
+    std::array<int16_t, 16> estimated;
+    // Largest absolute difference between a real and an estimated coefficient
+    int32_t maxDifference;
+
+    friend std::ostream &operator<<(std::ostream &os, const CoefficientFidelity &obj);
+};
+
+/**
+ * Decodes every dsp-adpcm channel of the stream and estimates its coefficients.
+ * @param context The stream context, must be dsp-adpcm encoded
+ * @param dataPtr Pointer to the sample data (same as for AudioPlayback::play)
+ */
+std::vector<CoefficientFidelity> analyzeCoefficients(const BfstmContext &context, const void *dataPtr);
+
+/**
+ * Runs analyzeCoefficients() on a background thread. The context and the data must outlive the returned future.
+ */
+std::future<std::vector<CoefficientFidelity>> analyzeCoefficientsAsync(const BfstmContext &context,
+                                                                       const void *dataPtr);
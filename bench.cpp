@@ -0,0 +1,11 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <iostream>
+#include "codec/CodecBenchmark.h"
+
+// OpenBFSTMBench [stream.bfstm [golden.pcm]]
+int main(int argc, char **argv) {
+    return runCodecBenchmarks(std::cout, argc > 1 ? argv[1] : nullptr, argc > 2 ? argv[2] : nullptr) ? 0 : 1;
+}
@@ -0,0 +1,374 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numbers>
+#include <random>
+#include <vector>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include "CodecBenchmark.h"
+#include "Crc32.h"
+#include "DspADPCM.h"
+#include "EncodeMetrics.h"
+#include "../MemoryResource.h"
+#include "../ThreadPool.h"
+#include "../format/bfstm/BfstmReader.h"
+#include "../format/bfstm/BfstmDecoder.h"
+#include "../format/bfstm/BfstmEncoder.h"
+
+// Three tones with a slow tremolo and some noise, deterministic so runs are comparable
+static std::vector<int16_t> generateSignal(uint32_t sampleRate, uint32_t seconds) {
+    std::vector<int16_t> pcm(sampleRate * seconds);
+    std::mt19937 rng{1234};
+    std::normal_distribution<double> noise{0.0, 200.0};
+    for (uint32_t i = 0; i < pcm.size(); ++i) {
+        double t = static_cast<double>(i) / sampleRate;
+        double tremolo = 0.6 + 0.4 * std::sin(2 * std::numbers::pi * 0.5 * t);
+        double v = 6000 * std::sin(2 * std::numbers::pi * 220 * t) + 4000 * std::sin(2 * std::numbers::pi * 1375 * t) +
+                   2000 * std::sin(2 * std::numbers::pi * 5100 * t);
+        pcm[i] = static_cast<int16_t>(std::clamp(v * tremolo + noise(rng), -32768.0, 32767.0));
+    }
+    return pcm;
+}
+
+static double calculateSnr(const int16_t *reference, const int16_t *decoded, uint32_t sampleCount) {
+    double signal = 0.0;
+    double error = 0.0;
+    for (uint32_t i = 0; i < sampleCount; ++i) {
+        double diff = static_cast<double>(reference[i]) - decoded[i];
+        signal += static_cast<double>(reference[i]) * reference[i];
+        error += diff * diff;
+    }
+    return error == 0.0 ? INFINITY : 10.0 * std::log10(signal / error);
+}
+
+// Computed independently from the format description: sample = clamp16((nibble * scale << 11) + 1024 + c1 * yn1 + c2 * yn2) >> 11
+static constexpr int16_t goldenCoefs[8][2]{
+        {1200, -400}, {2048, -1024}, {3000, -1500}, {0, 0}, {1800, -900}, {4095, -2048}, {-1000, 500}, {600, 200}
+};
+static constexpr int16_t goldenYn1 = 100;
+static constexpr int16_t goldenYn2 = -50;
+static constexpr uint8_t goldenAdpcm[]{
+        0x00, 0x12, 0x34, 0x56, 0x70, 0x89, 0xAB, 0xCD,
+        // Saturates at the top
+        0x1B, 0x77, 0x77, 0x77, 0x77, 0x77, 0x77, 0x77,
+        // Saturates at the bottom
+        0x5B, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88,
+        0x34, 0xF0, 0x1E, 0x2D, 0x3C, 0x4B, 0x5A, 0x69,
+        0x7C, 0x9F, 0x8E, 0x7D, 0x6C, 0x5B, 0x4A, 0x39
+};
+static constexpr int16_t goldenPcm[]{
+        69, 23, 3, 1, 5, 9, 11, 5, -7, -12, -12, -10, -8, -6,
+        14334, 28673, 32767, 32767, 30720, 28673, 27649, 27649, 28161, 28673, 28929, 28929, 28801, 28673,
+        12147, -20769, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768,
+        -16, 0, 16, -32, 32, -48, 48, -64, 64, -80, 80, -96, 96, -112,
+        -28695, -12514, -32768, -19014, 19901, -8314, 24084, -10140, 19861, -15652, 13738, -22080, 7161, -28730
+};
+
+static bool checkGoldenVector(std::ostream &out) {
+    constexpr uint32_t sampleCount = std::size(goldenPcm);
+    int16_t decoded[sampleCount];
+    int16_t yn1 = goldenYn1, yn2 = goldenYn2;
+    dspadpcm::decode(goldenAdpcm, decoded, yn1, yn2, goldenCoefs, sampleCount, 0);
+    bool success = std::memcmp(decoded, goldenPcm, sizeof(goldenPcm)) == 0 && yn1 == goldenPcm[sampleCount - 1] &&
+                   yn2 == goldenPcm[sampleCount - 2];
+    out << "  golden vector: " << (success ? "ok" : "FAILED") << std::endl;
+    return success;
+}
+
+static bool checkSyntheticRoundTrip(std::ostream &out) {
+    auto pcm = generateSignal(32000, 2);
+    auto sampleCount = static_cast<uint32_t>(pcm.size());
+    auto coefs = dspadpcm::calculateCoefficients(pcm.data(), sampleCount);
+    auto coefTable = reinterpret_cast<const int16_t (*)[2]>(coefs.data());
+    std::vector<uint8_t> adpcm(dspadpcm::getBytesForSamples(sampleCount));
+    int16_t yn1 = 0, yn2 = 0;
+    EncodeMetrics metrics{};
+    dspadpcm::encode(pcm.data(), adpcm.data(), yn1, yn2, coefTable, sampleCount, dspadpcm::EncodePreset::EXHAUSTIVE,
+                     {}, &metrics);
+    int16_t endYn1 = yn1, endYn2 = yn2;
+
+    // The encoder reconstructs exactly what the decoder produces, so its history is the golden end state
+    std::vector<int16_t> decoded(sampleCount);
+    yn1 = 0;
+    yn2 = 0;
+    dspadpcm::decode(adpcm.data(), decoded.data(), yn1, yn2, coefTable, sampleCount, 0);
+    double snr = calculateSnr(pcm.data(), decoded.data(), sampleCount);
+    bool success = yn1 == endYn1 && yn2 == endYn2 && snr > 20.0;
+
+    // The metrics of the encoder must agree with the decoded output
+    EncodeMetrics decodedMetrics{};
+    decodedMetrics.accumulate(pcm.data(), decoded.data(), sampleCount);
+    success &= metrics.errorEnergy == decodedMetrics.errorEnergy && metrics.peakError == decodedMetrics.peakError &&
+               std::abs(metrics.getSnr() - snr) < 1e-6;
+
+    // Decoding in pieces with a start sample inside a frame must give the same samples
+    std::vector<int16_t> pieces(sampleCount);
+    yn1 = 0;
+    yn2 = 0;
+    std::mt19937 rng{42};
+    for (uint32_t start = 0; start < sampleCount;) {
+        uint32_t frameStart = start / 14 * 14;
+        uint32_t count = std::min<uint32_t>(rng() % 5000 + 1, sampleCount - start);
+        // Resume from the history at the frame start, which is the end of the previous decoded frame
+        int16_t h1 = frameStart == 0 ? 0 : decoded[frameStart - 1];
+        int16_t h2 = frameStart < 2 ? 0 : decoded[frameStart - 2];
+        dspadpcm::decode(adpcm.data() + frameStart / 14 * 8, pieces.data() + start, h1, h2, coefTable, count,
+                         start - frameStart);
+        start += count;
+    }
+    success &= pieces == decoded;
+    out << "  synthetic round trip: " << (success ? "ok" : "FAILED") << std::endl;
+    return success;
+}
+
+// The vectorized frame search must produce the same frames as the reference search, including partial frames
+static bool checkFrameSearch(std::ostream &out) {
+    auto pcm = generateSignal(32000, 1);
+    auto sampleCount = static_cast<uint32_t>(pcm.size());
+    bool success = true;
+    for (auto preset: {dspadpcm::EncodePreset::FAST, dspadpcm::EncodePreset::BALANCED,
+                       dspadpcm::EncodePreset::EXHAUSTIVE}) {
+        auto coefs = dspadpcm::calculateCoefficients(pcm.data(), sampleCount, preset);
+        auto coefTable = reinterpret_cast<const int16_t (*)[2]>(coefs.data());
+        std::array<int16_t, 16> history{}, reference{};
+        for (uint32_t frame = 0; frame * 14 < sampleCount && success; ++frame) {
+            uint32_t frameSamples = std::min(14u, sampleCount - frame * 14);
+            if (frame % 97 == 96) frameSamples = frame % 13 + 1;
+            std::copy_n(pcm.data() + frame * 14, frameSamples, history.begin() + 2);
+            reference = history;
+            std::array<uint8_t, 8> adpcm{}, adpcmReference{};
+            dspadpcm::encodeFrame(history.data(), frameSamples, adpcm.data(), coefTable, preset);
+            dspadpcm::encodeFrameScalar(reference.data(), frameSamples, adpcmReference.data(), coefTable, preset);
+            success = adpcm == adpcmReference && history == reference;
+            history[0] = history[frameSamples];
+            history[1] = history[frameSamples + 1];
+        }
+    }
+    out << "  frame search (" << dspadpcm::getFrameSearchIsaName() << "): " << (success ? "ok" : "FAILED")
+        << std::endl;
+    return success;
+}
+
+static bool isSameContext(const DSPAdpcmContext &a, const DSPAdpcmContext &b) {
+    return a.header == b.header && a.yn1 == b.yn1 && a.yn2 == b.yn2;
+}
+
+// The speculative block-parallel encode must produce the same frames, contexts and metrics as the serial one
+static bool checkBlockParallelEncode(std::ostream &out) {
+    auto pcm = generateSignal(32000, 3);
+    auto sampleCount = static_cast<uint32_t>(pcm.size());
+    // Regions on, inside and right after block boundaries, the loop starts inside a frame
+    const BfstmRegionInfo regions[]{{14336, sampleCount}, {14336 * 2 + 5, sampleCount}, {sampleCount / 2, sampleCount}};
+    ThreadPool pool{};
+    bool success = true;
+    for (auto [blockSizeSamples, preset]: {std::pair{14336u, dspadpcm::EncodePreset::FAST},
+                                           std::pair{14336u, dspadpcm::EncodePreset::EXHAUSTIVE},
+                                           std::pair{14u * 20, dspadpcm::EncodePreset::BALANCED}}) {
+        std::vector<uint8_t> serial(dspadpcm::getBytesForSamples(sampleCount));
+        std::vector<uint8_t> parallel(serial.size());
+        auto expected = encodeBfstmChannel(pcm.data(), sampleCount, serial.data(), blockSizeSamples, 20001, regions,
+                                           preset);
+        auto result = encodeBfstmChannel(pcm.data(), sampleCount, parallel.data(), blockSizeSamples, 20001, regions,
+                                         preset, &pool);
+        success &= serial == parallel;
+        success &= std::memcmp(expected.channelInfo.coefficients, result.channelInfo.coefficients,
+                               sizeof(expected.channelInfo.coefficients)) == 0 &&
+                   isSameContext(expected.channelInfo.startContext, result.channelInfo.startContext) &&
+                   isSameContext(expected.channelInfo.loopContext, result.channelInfo.loopContext);
+        success &= std::ranges::equal(expected.seekHistory, result.seekHistory, [](const auto &a, const auto &b) {
+            return a.histSample1 == b.histSample1 && a.histSample2 == b.histSample2;
+        });
+        success &= std::ranges::equal(expected.regionContexts, result.regionContexts, isSameContext);
+        const auto &a = expected.metrics, &b = result.metrics;
+        success &= a.sampleCount == b.sampleCount && a.signalEnergy == b.signalEnergy &&
+                   a.errorEnergy == b.errorEnergy && a.peakError == b.peakError && a.clipCount == b.clipCount;
+    }
+    out << "  block-parallel encode: " << (success ? "ok" : "FAILED") << std::endl;
+    return success;
+}
+
+bool checkDecodeConformance(std::ostream &out) {
+    out << "DSP-ADPCM decode conformance" << std::endl;
+    bool success = checkGoldenVector(out);
+    success &= checkSyntheticRoundTrip(out);
+    success &= checkFrameSearch(out);
+    success &= checkBlockParallelEncode(out);
+    return success;
+}
+
+void benchmarkDecode(std::ostream &out) {
+    constexpr uint32_t sampleRate = 32000;
+    constexpr uint32_t seconds = 30;
+    auto pcm = generateSignal(sampleRate, seconds);
+    auto sampleCount = static_cast<uint32_t>(pcm.size());
+    auto coefs = dspadpcm::calculateCoefficients(pcm.data(), sampleCount, dspadpcm::EncodePreset::FAST);
+    auto coefTable = reinterpret_cast<const int16_t (*)[2]>(coefs.data());
+    std::vector<uint8_t> adpcm(dspadpcm::getBytesForSamples(sampleCount));
+    int16_t yn1 = 0, yn2 = 0;
+    dspadpcm::encode(pcm.data(), adpcm.data(), yn1, yn2, coefTable, sampleCount, dspadpcm::EncodePreset::FAST);
+
+    out << "DSP-ADPCM throughput (single core)" << std::endl;
+    std::vector<int16_t> decoded(sampleCount);
+    constexpr int runs = 5;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; ++i) {
+        yn1 = 0;
+        yn2 = 0;
+        dspadpcm::decode(adpcm.data(), decoded.data(), yn1, yn2, coefTable, sampleCount, 0);
+    }
+    double decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / runs;
+    out << "  decode: " << sampleCount / decodeSeconds / 1e6 << " MSamples/s" << std::endl;
+
+    for (auto preset: {dspadpcm::EncodePreset::FAST, dspadpcm::EncodePreset::EXHAUSTIVE}) {
+        start = std::chrono::steady_clock::now();
+        dspadpcm::calculateCoefficients(decoded.data(), sampleCount, preset);
+        double coefSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        out << "  calculateCoefficients (" << dspadpcm::getEncodeSettings(preset).name << "): "
+            << sampleCount / coefSeconds / 1e6 << " MSamples/s" << std::endl;
+    }
+}
+
+bool benchmarkChecksum(std::ostream &out) {
+    out << "CRC32 (" << crc32::getIsaName() << ")" << std::endl;
+    bool success = crc32::compute("123456789", 9) == 0xCBF43926;
+
+    // Every start alignment and tail length, split at arbitrary points
+    std::vector<uint8_t> data(64 << 20);
+    std::mt19937 rng{1234};
+    for (auto &byte: data) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    for (uint32_t i = 0; i < 2000 && success; ++i) {
+        size_t offset = rng() % 64;
+        size_t size = rng() % (i < 1000 ? 256 : 65536);
+        size_t split = size == 0 ? 0 : rng() % size;
+        uint32_t reference = crc32::updateSlicing8(0, data.data() + offset, size);
+        uint32_t crc = crc32::update(crc32::update(0, data.data() + offset, split), data.data() + offset + split,
+                                     size - split);
+        success = crc == reference;
+    }
+    out << "  consistency: " << (success ? "ok" : "FAILED") << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t crc = crc32::compute(data.data(), data.size());
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    uint32_t reference = crc32::updateSlicing8(0, data.data(), data.size());
+    double referenceSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    success &= crc == reference;
+    out << "  " << crc32::getIsaName() << ": " << data.size() / seconds / 1e9 << " GB/s, slicing-by-8: "
+        << data.size() / referenceSeconds / 1e9 << " GB/s" << std::endl;
+    return success;
+}
+
+bool benchmarkStreamFile(std::ostream &out, const char *path, const char *goldenPath) {
+    std::ifstream in{path, std::ios::binary};
+    if (!in) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return false;
+    }
+    MemoryResource resource{in};
+    BfstmReader reader{resource};
+    if (!reader.success || reader.m_Context.seekTable.empty()) {
+        std::cerr << path << " is no bfstm with seek section!" << std::endl;
+        return false;
+    }
+    const BfstmContext &context = reader.m_Context;
+    const auto &header = context.header;
+    const void *dataPtr = resource.getAsPtrUnsafe(header.dataSection->offset + 0x8 + context.streamInfo.sampleDataOffset);
+    uint32_t sampleCount = getStreamSampleCount(context.streamInfo);
+    uint32_t channelNum = context.streamInfo.channelNum;
+
+    out << path << ": " << channelNum << " channels, " << sampleCount << " samples" << std::endl;
+    if (!reader.checksumValid) {
+        out << "  checksum MISMATCH" << std::endl;
+    }
+    std::vector<int16_t> serial(sampleCount * channelNum);
+    std::vector<int16_t> parallel(sampleCount * channelNum);
+    ThreadPool single{0};
+    auto start = std::chrono::steady_clock::now();
+    // Without seek table every channel is decoded from the stream start
+    BfstmContext serialContext = context;
+    serialContext.seekTable.clear();
+    decodeBfstm(serialContext, dataPtr, serial.data(), single);
+    double serialSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ThreadPool pool{};
+    start = std::chrono::steady_clock::now();
+    decodeBfstm(context, dataPtr, parallel.data(), pool);
+    double parallelSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    bool success = serial == parallel;
+    out << "  serial: " << sampleCount * channelNum / serialSeconds / 1e6 << " MSamples/s, block-parallel ("
+        << pool.getThreadCount() + 1 << " threads): " << sampleCount * channelNum / parallelSeconds / 1e6
+        << " MSamples/s, seek history " << (success ? "consistent" : "INCONSISTENT") << std::endl;
+    success &= reader.checksumValid;
+
+    if (goldenPath) {
+        std::ifstream goldenIn{goldenPath, std::ios::binary};
+        std::vector<int16_t> golden(sampleCount);
+        goldenIn.read(reinterpret_cast<char *>(golden.data()), sampleCount * sizeof(int16_t));
+        bool matches = goldenIn && std::equal(golden.begin(), golden.end(), serial.begin());
+        out << "  golden pcm: " << (matches ? "ok" : "FAILED") << std::endl;
+        success &= matches;
+    }
+    return success;
+}
+
+void benchmarkEncodePresets(std::ostream &out) {
+    constexpr uint32_t sampleRate = 32000;
+    constexpr uint32_t seconds = 10;
+    auto pcm = generateSignal(sampleRate, seconds);
+    auto sampleCount = static_cast<uint32_t>(pcm.size());
+    std::vector<uint8_t> adpcm(dspadpcm::getBytesForSamples(sampleCount));
+
+    out << "DSP-ADPCM encode presets, " << seconds << " s mono at " << sampleRate << " Hz, frame search "
+        << dspadpcm::getFrameSearchIsaName() << std::endl;
+    for (auto preset: {dspadpcm::EncodePreset::FAST, dspadpcm::EncodePreset::BALANCED,
+                       dspadpcm::EncodePreset::EXHAUSTIVE}) {
+        auto start = std::chrono::steady_clock::now();
+        auto coefs = dspadpcm::calculateCoefficients(pcm.data(), sampleCount, preset);
+        auto coefTable = reinterpret_cast<const int16_t (*)[2]>(coefs.data());
+        auto coefEnd = std::chrono::steady_clock::now();
+        int16_t yn1 = 0, yn2 = 0;
+        EncodeMetrics metrics{};
+        dspadpcm::encode(pcm.data(), adpcm.data(), yn1, yn2, coefTable, sampleCount, preset, {}, &metrics);
+        auto end = std::chrono::steady_clock::now();
+
+        double coefSeconds = std::chrono::duration<double>(coefEnd - start).count();
+        double totalSeconds = std::chrono::duration<double>(end - start).count();
+        out << "  " << dspadpcm::getEncodeSettings(preset).name << ": " << sampleCount / totalSeconds / 1e6
+            << " MSamples/s (" << seconds / totalSeconds << "x realtime, coefficients "
+            << coefSeconds / totalSeconds * 100 << "%), " << metrics << std::endl;
+    }
+
+    // Whole channel with the block size of a 0x2000 byte block, serial and speculative block-parallel
+    constexpr uint32_t blockSizeSamples = 14336;
+    ThreadPool pool{};
+    auto start = std::chrono::steady_clock::now();
+    encodeBfstmChannel(pcm.data(), sampleCount, adpcm.data(), blockSizeSamples, std::nullopt, {});
+    double serialSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    encodeBfstmChannel(pcm.data(), sampleCount, adpcm.data(), blockSizeSamples, std::nullopt, {},
+                       dspadpcm::EncodePreset::EXHAUSTIVE, &pool);
+    double parallelSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    out << "  " << dspadpcm::getEncodeSettings(dspadpcm::EncodePreset::EXHAUSTIVE).name << " channel: serial "
+        << sampleCount / serialSeconds / 1e6 << " MSamples/s, block-parallel (" << pool.getThreadCount() + 1
+        << " threads): " << sampleCount / parallelSeconds / 1e6 << " MSamples/s" << std::endl;
+}
+
+bool runCodecBenchmarks(std::ostream &out, const char *streamPath, const char *goldenPath) {
+    bool success = checkDecodeConformance(out);
+    benchmarkDecode(out);
+    benchmarkEncodePresets(out);
+    success &= benchmarkChecksum(out);
+    if (streamPath) {
+        success &= benchmarkStreamFile(out, streamPath, goldenPath);
+    }
+    return success;
+}
@@ -0,0 +1,48 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <ostream>
+
+/**
+ * Decodes a fixed dsp-adpcm vector (including clamping edge cases) and a synthetic encoded signal and compares them
+ * with golden pcm. Split decodes at arbitrary start samples must match the continuous decode and the vectorized frame
+ * search of the encoder must match the scalar one and the block-parallel channel encode must match the serial one.
+ * @return true if all checks passed
+ */
+bool checkDecodeConformance(std::ostream &out);
+
+/**
+ * Reports single core throughput of dspadpcm::decode and dspadpcm::calculateCoefficients.
+ */
+void benchmarkDecode(std::ostream &out);
+
+/**
+ * Compares crc32::update with the table implementation for all alignments and split points and reports throughput.
+ * @return true if all checks passed
+ */
+bool benchmarkChecksum(std::ostream &out);
+
+/**
+ * Decodes a dsp-adpcm bfstm serially and block-parallel, compares both and optionally the first channel with a golden
+ * raw pcm16 file (native endian) and reports throughput.
+ * @param goldenPath May be nullptr
+ * @return true if all checks passed
+ */
+bool benchmarkStreamFile(std::ostream &out, const char *path, const char *goldenPath);
+
+/**
+ * Encodes a synthetic signal with every dsp-adpcm encode preset and reports throughput and SNR, and the throughput of
+ * the serial and the block-parallel channel encode.
+ */
+void benchmarkEncodePresets(std::ostream &out);
+
+/**
+ * Runs the conformance checks and all benchmarks, the stream benchmark only if a path is given.
+ * @param streamPath May be nullptr
+ * @param goldenPath May be nullptr
+ * @return true if all checks passed
+ */
+bool runCodecBenchmarks(std::ostream &out, const char *streamPath, const char *goldenPath);
@@ -0,0 +1,172 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <array>
+#include <bit>
+#include <cstring>
+#include "Crc32.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRC32_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define CRC32_ARM
+#include <arm_acle.h>
+#endif
+
+namespace {
+    using Tables = std::array<std::array<uint32_t, 256>, 8>;
+
+    constexpr Tables makeTables() {
+        Tables tables{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+            }
+            tables[0][i] = crc;
+        }
+        // tables[k] advances a byte by k more zero bytes
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int k = 1; k < 8; ++k) {
+                uint32_t prev = tables[k - 1][i];
+                tables[k][i] = (prev >> 8) ^ tables[0][prev & 0xFF];
+            }
+        }
+        return tables;
+    }
+
+    constexpr Tables tables = makeTables();
+
+    uint32_t loadLe32(const uint8_t *p) {
+        uint32_t value;
+        std::memcpy(&value, p, 4);
+        if constexpr (std::endian::native == std::endian::big) {
+            value = __builtin_bswap32(value);
+        }
+        return value;
+    }
+
+    // crc is the inverted running state
+    uint32_t slicing8(uint32_t crc, const uint8_t *p, size_t size) {
+        for (; size >= 8; p += 8, size -= 8) {
+            uint32_t one = loadLe32(p) ^ crc;
+            uint32_t two = loadLe32(p + 4);
+            crc = tables[7][one & 0xFF] ^ tables[6][(one >> 8) & 0xFF] ^ tables[5][(one >> 16) & 0xFF] ^
+                  tables[4][one >> 24] ^ tables[3][two & 0xFF] ^ tables[2][(two >> 8) & 0xFF] ^
+                  tables[1][(two >> 16) & 0xFF] ^ tables[0][two >> 24];
+        }
+        for (; size > 0; ++p, --size) {
+            crc = (crc >> 8) ^ tables[0][(crc ^ *p) & 0xFF];
+        }
+        return crc;
+    }
+
+#ifdef CRC32_X86
+    // Folding with carry-less multiplication, see Intel's "Fast CRC Computation for Generic Polynomials Using
+    // PCLMULQDQ Instruction". The constants are the bit reflected fold constants for four lanes and one lane, the
+    // 64 bit reduction constant, P and the Barrett constant (the same as in zlib).
+    __attribute__((target("pclmul,sse4.1"))) inline __m128i fold(__m128i x, __m128i k, __m128i next) {
+        __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+        __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+        return _mm_xor_si128(_mm_xor_si128(lo, hi), next);
+    }
+
+    // Takes at least 64 bytes, only whole 16 byte blocks are consumed.
+    __attribute__((target("pclmul,sse4.1"))) uint32_t foldPclmul(uint32_t crc, const uint8_t *&p, size_t &size) {
+        const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+        const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+        const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124);
+        const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+        const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+        __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16));
+        __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 32));
+        __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 48));
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int32_t>(crc)));
+        p += 64;
+        size -= 64;
+
+        // Four independent lanes hide the multiplication latency
+        for (; size >= 64; p += 64, size -= 64) {
+            x1 = fold(x1, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+            x2 = fold(x2, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16)));
+            x3 = fold(x3, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 32)));
+            x4 = fold(x4, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 48)));
+        }
+
+        x1 = fold(x1, k3k4, x2);
+        x1 = fold(x1, k3k4, x3);
+        x1 = fold(x1, k3k4, x4);
+        for (; size >= 16; p += 16, size -= 16) {
+            x1 = fold(x1, k3k4, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+        }
+
+        // 128 to 64 bits
+        __m128i x = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(x1, k3k4, 0x10));
+        x = _mm_xor_si128(_mm_srli_si128(x, 4), _mm_clmulepi64_si128(_mm_and_si128(x, mask32), k5, 0x00));
+
+        // Barrett reduction to 32 bits
+        __m128i t = _mm_clmulepi64_si128(_mm_and_si128(x, mask32), poly, 0x10);
+        t = _mm_clmulepi64_si128(_mm_and_si128(t, mask32), poly, 0x00);
+        return static_cast<uint32_t>(_mm_extract_epi32(_mm_xor_si128(x, t), 1));
+    }
+
+    uint32_t updatePclmul(uint32_t crc, const uint8_t *p, size_t size) {
+        if (size >= 64) {
+            crc = foldPclmul(crc, p, size);
+        }
+        return slicing8(crc, p, size);
+    }
+#endif
+
+#ifdef CRC32_ARM
+    uint32_t updateArm(uint32_t crc, const uint8_t *p, size_t size) {
+        for (; size >= 8; p += 8, size -= 8) {
+            uint64_t value;
+            std::memcpy(&value, p, 8);
+            crc = __crc32d(crc, value);
+        }
+        for (; size > 0; ++p, --size) {
+            crc = __crc32b(crc, *p);
+        }
+        return crc;
+    }
+#endif
+
+    struct Implementation {
+        const char *name;
+
+        uint32_t (*update)(uint32_t, const uint8_t *, size_t);
+    };
+
+    Implementation selectImplementation() {
+#ifdef CRC32_X86
+        if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) return {"pclmul", updatePclmul};
+#elif defined(CRC32_ARM)
+        return {"armv8-crc", updateArm};
+#endif
+        return {"slicing-by-8", slicing8};
+    }
+
+    const Implementation &implementation() {
+        static const Implementation selected = selectImplementation();
+        return selected;
+    }
+}
+
+namespace crc32 {
+    uint32_t update(uint32_t crc, const void *data, size_t size) {
+        return ~implementation().update(~crc, static_cast<const uint8_t *>(data), size);
+    }
+
+    uint32_t updateSlicing8(uint32_t crc, const void *data, size_t size) {
+        return ~slicing8(~crc, static_cast<const uint8_t *>(data), size);
+    }
+
+    const char *getIsaName() {
+        return implementation().name;
+    }
+}
@@ -0,0 +1,32 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * CRC-32 (IEEE 802.3, reflected, like zlib). The implementation is chosen once at runtime: carry-less multiplication
+ * folding on x86, the crc32 instructions on armv8 and slicing-by-8 tables everywhere else.
+ */
+namespace crc32 {
+    /**
+     * Continues a checksum, crc32::update(crc32::update(0, a), b) equals the checksum of a followed by b.
+     * @param crc The checksum of the previous data, 0 for the first call
+     */
+    uint32_t update(uint32_t crc, const void *data, size_t size);
+
+    inline uint32_t compute(const void *data, size_t size) {
+        return update(0, data, size);
+    }
+
+    // The table based reference implementation
+    uint32_t updateSlicing8(uint32_t crc, const void *data, size_t size);
+
+    /**
+     * @return The name of the implementation update() uses
+     */
+    const char *getIsaName();
+}
@@ -10,6 +10,13 @@
 #include <cstring>
 #include <memory>
 #include "DspADPCM.h"
+#include "EncodeMetrics.h"
+#include "SampleConvert.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define DSPADPCM_X86
+#include <immintrin.h>
+#endif
 
 static int8_t nibbleToSHalfbyte[] = {0, 1, 2, 3, 4, 5, 6, 7, -8, -7, -6, -5, -4, -3, -2, -1};
 
@@ -25,8 +32,8 @@ inline short clamp16(const int value) {
     if (value > 32767) {
         return 32767;
     }
-    if (value < -32678) {
-        return -32678;
+    if (value < -32768) {
+        return -32768;
     }
     return static_cast<short>(value);
 }
@@ -239,7 +246,7 @@ double ContrastVectors(std::array<double, 3> &source1, std::vector<std::array<do
     return val1 + (2.0 * val * val2) + (2.0 * (-source2[row][1] * val + -source2[row][2]) * val3);
 }
 
-void FilterRecords(std::array<std::array<double, 3>, 8> &vecBest, int exp, std::vector<std::array<double, 3>> &records, int recordCount) {
+void FilterRecords(std::array<std::array<double, 3>, 8> &vecBest, int exp, std::vector<std::array<double, 3>> &records, int recordCount, int passes) {
     std::array<std::array<double, 3>, 8> bufferList{};
 
     std::array<std::array<double, 3>, 3> mtx{};
@@ -247,7 +254,7 @@ void FilterRecords(std::array<std::array<double, 3>, 8> &vecBest, int exp, std::
     std::array<int, 8> buffer1{};
     std::array<double, 3> buffer2{};
 
-    for (int x = 0; x < 2; x++) {
+    for (int x = 0; x < passes; x++) {
         for (int y = 0; y < exp; y++) {
             buffer1[y] = 0;
             for (int i = 0; i <= 2; i++)
@@ -280,16 +287,18 @@ void FilterRecords(std::array<std::array<double, 3>, 8> &vecBest, int exp, std::
 }
 
 namespace dspadpcm {
-    void decode(const uint8_t *src, short *dst, short &yn1, short &yn2, const int16_t (*coefs)[2], uint32_t sampleCount,
-                uint32_t startSample) {
-        //Each DSP-ADPCM group is 8 bytes long. It contains 1 header byte, and 7 sample bytes. so 8 bytes are 7 samples
+    // Calls sink(index, sample) for every decoded sample, the decode loop is shared by all output formats
+    template<typename Sink>
+    static void decodeSamples(const uint8_t *src, short &yn1, short &yn2, const int16_t (*coefs)[2],
+                              uint32_t sampleCount, uint32_t startSample, Sink &&sink) {
+        //Each DSP-ADPCM group is 8 bytes long. It contains 1 header byte, and 7 sample bytes. so 8 bytes are 14 samples
 
-        uint32_t startHeaderIndex = startSample / 7 * 8;
+        uint32_t startHeaderIndex = startSample / 14 * 8;
 
         //Set initial values.
         uint32_t dstIndex = 0;
         uint32_t srcIndex = startHeaderIndex;
-        uint32_t remainingNotPlayed = startSample % 7;
+        uint32_t remainingNotPlayed = startSample % 14;
 
         //Until all samples decoded.
         while (dstIndex < sampleCount) {
@@ -318,7 +327,7 @@ namespace dspadpcm {
                     yn1 = sample;
                     if (remainingNotPlayed > 0) --remainingNotPlayed;
                     else
-                        dst[dstIndex++] = sample;
+                        sink(dstIndex++, sample);
 
                     if (dstIndex >= sampleCount) break;
                 }
@@ -327,59 +336,91 @@ namespace dspadpcm {
         }
     }
 
-    std::array<int16_t, 16> calculateCoefficients(const int16_t *pcm16samples, uint32_t sampleCount) {
-        uint32_t frameCount = (sampleCount + 13) / 14;
-
-        std::array<int16_t, 28> pcmHistBuffer{};
-
-        std::array<int16_t, 16> coefs{};
-
-        std::array<double, 3> vec1{};
-        std::array<double, 3> vec2{};
-        std::array<double, 3> buffer{};
-
-        std::array<std::array<double, 3>, 3> mtx{};
-
-        std::array<int, 3> vecIdxs{};
+    void decode(const uint8_t *src, short *dst, short &yn1, short &yn2, const int16_t (*coefs)[2], uint32_t sampleCount,
+                uint32_t startSample) {
+        decodeSamples(src, yn1, yn2, coefs, sampleCount, startSample, [dst](uint32_t index, short sample) {
+            dst[index] = sample;
+        });
+    }
 
-        std::vector<std::array<double, 3>> records;
-        records.reserve(frameCount * 2);
+    void decodeMix(const uint8_t *src, float *mix, short &yn1, short &yn2, const int16_t (*coefs)[2],
+                   uint32_t sampleCount, uint32_t startSample, sampleconv::StereoGain gain) {
+        const float left = gain.left / 32768.0f;
+        const float right = gain.right / 32768.0f;
+        decodeSamples(src, yn1, yn2, coefs, sampleCount, startSample, [mix, left, right](uint32_t index, short sample) {
+            mix[index * 2] += static_cast<float>(sample) * left;
+            mix[index * 2 + 1] += static_cast<float>(sample) * right;
+        });
+    }
 
-        int recordCount = 0;
+    CoefficientBuilder::CoefficientBuilder(EncodePreset preset) : m_Settings(getEncodeSettings(preset)) {
+    }
 
-        std::array<std::array<double, 3>, 8> vecBest{};
+    void CoefficientBuilder::add(const int16_t *samples, uint32_t count) {
+        while (count > 0) {
+            uint32_t copied = std::min(count, 14 - m_FrameFill);
+            memcpy(&m_PcmHistBuffer[14 + m_FrameFill], samples, copied * sizeof(int16_t));
+            m_FrameFill += copied;
+            samples += copied;
+            count -= copied;
+            if (m_FrameFill == 14) {
+                analyzeFrame();
+            }
+        }
+    }
 
-        /* Iterate though one frame at a time */
-        for (int sample = 0, remaining = sampleCount; sample < sampleCount; sample += 14, remaining -= 14) {
-            std::fill_n(&pcmHistBuffer[14], 14, 0);
-            memcpy(&pcmHistBuffer[14], &pcm16samples[sample], std::min(14, remaining));
+    void CoefficientBuilder::analyzeFrame() {
+        /* The faster presets only look at every n-th frame */
+        if (m_FrameIndex % m_Settings.coefFrameStride == 0) {
+            std::array<double, 3> vec1{};
+            std::array<double, 3> buffer{};
+            std::array<std::array<double, 3>, 3> mtx{};
+            std::array<int, 3> vecIdxs{};
 
-            InnerProductMerge(vec1, pcmHistBuffer);
+            InnerProductMerge(vec1, m_PcmHistBuffer);
             if (std::abs(vec1[0]) > 10.0) {
-                OuterProductMerge(mtx, pcmHistBuffer);
+                OuterProductMerge(mtx, m_PcmHistBuffer);
                 if (!AnalyzeRanges(mtx, vecIdxs, buffer)) {
                     BidirectionalFilter(mtx, vecIdxs, vec1);
                     if (!QuadraticMerge(vec1)) {
-                        FinishRecord(vec1, records, recordCount);
-                        recordCount++;
+                        m_Records.emplace_back();
+                        FinishRecord(vec1, m_Records, static_cast<int>(m_Records.size() - 1));
                     }
                 }
             }
+        }
+        // The frame is the history of the next one
+        memcpy(&m_PcmHistBuffer[0], &m_PcmHistBuffer[14], 14 * sizeof(int16_t));
+        std::fill_n(&m_PcmHistBuffer[14], 14, 0);
+        m_FrameFill = 0;
+        ++m_FrameIndex;
+    }
 
-            memcpy(&pcmHistBuffer[0], &pcmHistBuffer[14], 14);
+    std::array<int16_t, 16> CoefficientBuilder::finish() {
+        // The last frame is zero padded
+        if (m_FrameFill > 0) {
+            analyzeFrame();
         }
+        int recordCount = static_cast<int>(m_Records.size());
+
+        std::array<int16_t, 16> coefs{};
+        std::array<double, 3> vec1{};
+        std::array<double, 3> vec2{};
+        std::array<std::array<double, 3>, 3> mtx{};
+        std::array<std::array<double, 3>, 8> vecBest{};
 
         vec1[0] = 1.0;
         vec1[1] = 0.0;
         vec1[2] = 0.0;
 
         for (int z = 0; z < recordCount; z++) {
-            MatrixFilter(records, z, vecBest[0], mtx);
+            MatrixFilter(m_Records, z, vecBest[0], mtx);
             for (int y = 1; y <= 2; y++)
                 vec1[y] += vecBest[0][y];
         }
-        for (int y = 1; y <= 2; y++)
-            vec1[y] /= recordCount;
+        if (recordCount > 0)
+            for (int y = 1; y <= 2; y++)
+                vec1[y] /= recordCount;
 
         MergeFinishRecord(vec1, vecBest[0]);
 
@@ -394,7 +435,7 @@ namespace dspadpcm {
                     vecBest[exp + i][y] = (0.01 * vec2[y]) + vecBest[i][y];
             ++w;
             exp = 1 << w;
-            FilterRecords(vecBest, exp, records, recordCount);
+            FilterRecords(vecBest, exp, m_Records, recordCount, m_Settings.refinePasses);
         }
 
         /* Write output */
@@ -409,33 +450,374 @@ namespace dspadpcm {
         return coefs;
     }
 
-    /*std::unique_ptr<uint8_t> Encode(const int16_t *pcm, uint32_t sampleCount, const std::array<int16_t, 16> &coefficients) {
-        var adpcm = new byte[SampleCountToByteCount(sampleCount)];
+    std::array<int16_t, 16> calculateCoefficients(const int16_t *pcm16samples, uint32_t sampleCount, EncodePreset preset) {
+        CoefficientBuilder builder{preset};
+        builder.add(pcm16samples, sampleCount);
+        return builder.finish();
+    }
 
-        var pcmBuffer = new short[2 + SamplesPerFrame];
-        var adpcmBuffer = new byte[BytesPerFrame];
+    const EncodeSettings &getEncodeSettings(EncodePreset preset) {
+        static constexpr std::array<EncodeSettings, 3> settings{{
+                {"fast", 4, 1, 2},
+                {"balanced", 1, 1, 4},
+                {"exhaustive", 1, 2, 8}
+        }};
+        return settings[static_cast<uint8_t>(preset)];
+    }
 
-        pcmBuffer[0] = config.History2;
-        pcmBuffer[1] = config.History1;
+    /* The faster presets only search the coef sets with the best plain prediction */
+    static std::array<bool, 8> selectCandidates(const std::array<int32_t, 8> &distances,
+                                                const EncodeSettings &settings) {
+        std::array<bool, 8> candidate{};
+        std::array<int, 8> order{0, 1, 2, 3, 4, 5, 6, 7};
+        std::stable_sort(order.begin(), order.end(), [&distances](int a, int b) {
+            return std::abs(distances[a]) < std::abs(distances[b]);
+        });
+        for (uint32_t i = 0; i < settings.candidateCoefs; i++)
+            candidate[order[i]] = true;
+        return candidate;
+    }
 
-        int frameCount = sampleCount.DivideByRoundUp(SamplesPerFrame);
-        var buffers = new AdpcmEncodeBuffers();
+    /* Scale before the first search pass, the pass increments it */
+    static int32_t getInitialScale(int32_t distance) {
+        int32_t scale;
+        for (scale = 0; (scale <= 12) && ((distance > 7) || (distance < -8)); scale++, distance /= 2) {
+        }
+        return (scale <= 1) ? -1 : scale - 2;
+    }
 
-        for (int frame = 0; frame < frameCount; frame++)
-        {
-            int samplesToCopy = Math.Min(sampleCount - frame * SamplesPerFrame, SamplesPerFrame);
-            Array.Copy(pcm, frame * SamplesPerFrame, pcmBuffer, 2, samplesToCopy);
-            Array.Clear(pcmBuffer, 2 + samplesToCopy, SamplesPerFrame - samplesToCopy);
+    /* Adjusts the scale after a pass, returns whether another pass is needed */
+    static bool adjustScale(int32_t &scale, int32_t index) {
+        for (int x = index + 8; x > 256; x >>= 1)
+            if (++scale >= 12)
+                scale = 11;
+        return (scale < 12) && (index > 1);
+    }
+
+    static void writeBestFrame(int16_t *pcmInOut, uint32_t sampleCount, uint8_t *adpcmOut,
+                               const std::array<double, 8> &totalError, const std::array<int32_t, 8> &scale,
+                               const std::array<std::array<int32_t, 16>, 8> &inSamples,
+                               std::array<std::array<int32_t, 14>, 8> &outSamples) {
+        double min = std::numeric_limits<double>::max();
+        int bestIndex = 0;
+        for (int i = 0; i < 8; i++) {
+            if (totalError[i] < min) {
+                min = totalError[i];
+                bestIndex = i;
+            }
+        }
+
+        /* Write converted samples */
+        for (uint32_t s = 0; s < sampleCount; s++)
+            pcmInOut[s + 2] = static_cast<int16_t>(inSamples[bestIndex][s + 2]);
+
+        /* Write ps */
+        adpcmOut[0] = static_cast<uint8_t>((bestIndex << 4) | (scale[bestIndex] & 0xF));
 
-            DspEncodeFrame(pcmBuffer, SamplesPerFrame, adpcmBuffer, coefs, buffers);
+        /* Zero remaining samples */
+        for (uint32_t s = sampleCount; s < 14; s++)
+            outSamples[bestIndex][s] = 0;
 
-            Array.Copy(adpcmBuffer, 0, adpcm, frame * BytesPerFrame, SampleCountToByteCount(samplesToCopy));
+        /* Write output samples */
+        for (int y = 0; y < 7; y++) {
+            adpcmOut[y + 1] = static_cast<uint8_t>((outSamples[bestIndex][y * 2] << 4) |
+                                                   (outSamples[bestIndex][y * 2 + 1] & 0xF));
+        }
+    }
+
+    void encodeFrameScalar(int16_t *pcmInOut, uint32_t sampleCount, uint8_t *adpcmOut, const int16_t coefs[8][2],
+                           EncodePreset preset) {
+        const EncodeSettings &settings = getEncodeSettings(preset);
+        std::array<std::array<int32_t, 16>, 8> inSamples{};
+        std::array<std::array<int32_t, 14>, 8> outSamples{};
+        std::array<int32_t, 8> scale{};
+        std::array<double, 8> totalError{};
+        std::array<int32_t, 8> distances{};
+
+        /* Distance of the plain prediction for every coef set */
+        for (int i = 0; i < 8; i++) {
+            int v1, v2, v3;
+            int distance = 0;
+
+            /* Set yn values */
+            inSamples[i][0] = pcmInOut[0];
+            inSamples[i][1] = pcmInOut[1];
+
+            /* Round and clamp samples for this coef set */
+            for (uint32_t s = 0; s < sampleCount; s++) {
+                /* Multiply previous samples by coefs */
+                inSamples[i][s + 2] = v1 = ((pcmInOut[s] * coefs[i][1]) + (pcmInOut[s + 1] * coefs[i][0])) / 2048;
+                /* Subtract from current sample */
+                v2 = pcmInOut[s + 2] - v1;
+                /* Clamp */
+                v3 = clamp16(v2);
+                /* Compare distance */
+                if (std::abs(v3) > std::abs(distance))
+                    distance = v3;
+            }
+            distances[i] = distance;
+        }
 
+        std::array<bool, 8> candidate = selectCandidates(distances, settings);
+
+        /* Iterate through each coef set, finding the set with the smallest error */
+        for (int i = 0; i < 8; i++) {
+            if (!candidate[i]) {
+                totalError[i] = std::numeric_limits<double>::max();
+                continue;
+            }
+            int v1, v2, v3;
+            int index;
+
+            /* Set initial scale */
+            scale[i] = getInitialScale(distances[i]);
+
+            do {
+                scale[i]++;
+                totalError[i] = 0;
+                index = 0;
+
+                for (uint32_t s = 0; s < sampleCount; s++) {
+                    /* Multiply previous */
+                    v1 = ((inSamples[i][s] * coefs[i][1]) + (inSamples[i][s + 1] * coefs[i][0]));
+                    /* Evaluate from real sample */
+                    v2 = (pcmInOut[s + 2] << 11) - v1;
+                    /* Round to nearest sample */
+                    v3 = (v2 > 0) ? static_cast<int>(static_cast<double>(v2) / (1 << scale[i]) / 2048 + 0.4999999f)
+                                  : static_cast<int>(static_cast<double>(v2) / (1 << scale[i]) / 2048 - 0.4999999f);
+
+                    /* Clamp sample and set index */
+                    if (v3 < -8) {
+                        if (index < (v3 = -8 - v3))
+                            index = v3;
+                        v3 = -8;
+                    } else if (v3 > 7) {
+                        if (index < (v3 -= 7))
+                            index = v3;
+                        v3 = 7;
+                    }
+
+                    /* Store result */
+                    outSamples[i][s] = v3;
+
+                    /* Round and expand */
+                    v1 = (v1 + ((v3 * (1 << scale[i])) << 11) + 1024) >> 11;
+                    /* Clamp and store */
+                    inSamples[i][s + 2] = v2 = clamp16(v1);
+                    /* Accumulate error */
+                    v3 = pcmInOut[s + 2] - v2;
+                    totalError[i] += v3 * static_cast<double>(v3);
+                }
+            } while (adjustScale(scale[i], index));
+        }
+
+        writeBestFrame(pcmInOut, sampleCount, adpcmOut, totalError, scale, inSamples, outSamples);
+    }
+
+#ifdef DSPADPCM_X86
+    /*
+     * The 8 coef sets are the 8 lanes. The rounding of the scalar search, trunc(v2 / 2^k +- 0.4999999f) with
+     * k = scale + 11, is exact in double and equals (|v2| + 2^(k - 1) - 1) >> k with the sign of v2 for k <= 23.
+     * The error sums are exact integers in double as well, so everything is done with integers.
+     */
+    __attribute__((target("avx2")))
+    static std::array<int32_t, 8> getDistancesAvx2(const int16_t *pcmInOut, uint32_t sampleCount, __m256i coef0,
+                                                   __m256i coef1) {
+        __m256i distance = _mm256_setzero_si256();
+        for (uint32_t s = 0; s < sampleCount; s++) {
+            __m256i product = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(pcmInOut[s]), coef1),
+                                               _mm256_mullo_epi32(_mm256_set1_epi32(pcmInOut[s + 1]), coef0));
+            /* Division by 2048 rounding towards zero */
+            __m256i bias = _mm256_and_si256(_mm256_srai_epi32(product, 31), _mm256_set1_epi32(2047));
+            __m256i v1 = _mm256_srai_epi32(_mm256_add_epi32(product, bias), 11);
+            __m256i v3 = _mm256_sub_epi32(_mm256_set1_epi32(pcmInOut[s + 2]), v1);
+            v3 = _mm256_min_epi32(_mm256_max_epi32(v3, _mm256_set1_epi32(-32768)), _mm256_set1_epi32(32767));
+            __m256i greater = _mm256_cmpgt_epi32(_mm256_abs_epi32(v3), _mm256_abs_epi32(distance));
+            distance = _mm256_blendv_epi8(distance, v3, greater);
+        }
+        alignas(32) std::array<int32_t, 8> result;
+        _mm256_store_si256(reinterpret_cast<__m256i *>(result.data()), distance);
+        return result;
+    }
+
+    // One search pass with the given scale for every lane, the outputs are lane-major
+    __attribute__((target("avx2")))
+    static void searchPassAvx2(const int16_t *pcmInOut, uint32_t sampleCount, __m256i coef0, __m256i coef1,
+                               const std::array<int32_t, 8> &scale, std::array<std::array<int32_t, 8>, 16> &inSamples,
+                               std::array<std::array<int32_t, 8>, 14> &outSamples, std::array<uint64_t, 8> &error,
+                               std::array<int32_t, 8> &index) {
+        __m256i shift = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(scale.data())),
+                                         _mm256_set1_epi32(11));
+        __m256i rounding = _mm256_sub_epi32(_mm256_sllv_epi32(_mm256_set1_epi32(1),
+                                                              _mm256_sub_epi32(shift, _mm256_set1_epi32(1))),
+                                            _mm256_set1_epi32(1));
+        __m256i yn2 = _mm256_set1_epi32(pcmInOut[0]);
+        __m256i yn1 = _mm256_set1_epi32(pcmInOut[1]);
+        __m256i maxIndex = _mm256_setzero_si256();
+        __m256i errorEven = _mm256_setzero_si256();
+        __m256i errorOdd = _mm256_setzero_si256();
+
+        for (uint32_t s = 0; s < sampleCount; s++) {
+            __m256i sample = _mm256_set1_epi32(pcmInOut[s + 2]);
+            __m256i v1 = _mm256_add_epi32(_mm256_mullo_epi32(yn2, coef1), _mm256_mullo_epi32(yn1, coef0));
+            __m256i v2 = _mm256_sub_epi32(_mm256_slli_epi32(sample, 11), v1);
+
+            __m256i rounded = _mm256_srlv_epi32(_mm256_add_epi32(_mm256_abs_epi32(v2), rounding), shift);
+            __m256i v3 = _mm256_sign_epi32(rounded, v2);
+
+            /* Clamp sample and set index */
+            maxIndex = _mm256_max_epi32(maxIndex, _mm256_max_epi32(_mm256_sub_epi32(_mm256_set1_epi32(-8), v3),
+                                                                   _mm256_sub_epi32(v3, _mm256_set1_epi32(7))));
+            v3 = _mm256_min_epi32(_mm256_max_epi32(v3, _mm256_set1_epi32(-8)), _mm256_set1_epi32(7));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(outSamples[s].data()), v3);
+
+            /* Round and expand */
+            v1 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(v1, _mm256_sllv_epi32(v3, shift)),
+                                                    _mm256_set1_epi32(1024)), 11);
+            v1 = _mm256_min_epi32(_mm256_max_epi32(v1, _mm256_set1_epi32(-32768)), _mm256_set1_epi32(32767));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(inSamples[s + 2].data()), v1);
+            yn2 = yn1;
+            yn1 = v1;
+
+            /* Accumulate error, the squares need 64 bits */
+            __m256i diff = _mm256_sub_epi32(sample, v1);
+            errorEven = _mm256_add_epi64(errorEven, _mm256_mul_epi32(diff, diff));
+            __m256i odd = _mm256_srli_epi64(diff, 32);
+            errorOdd = _mm256_add_epi64(errorOdd, _mm256_mul_epi32(odd, odd));
+        }
+
+        alignas(32) std::array<uint64_t, 4> even, odd;
+        _mm256_store_si256(reinterpret_cast<__m256i *>(even.data()), errorEven);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(odd.data()), errorOdd);
+        for (int i = 0; i < 4; i++) {
+            error[i * 2] = even[i];
+            error[i * 2 + 1] = odd[i];
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(index.data()), maxIndex);
+    }
+
+    __attribute__((target("avx2")))
+    static void encodeFrameAvx2(int16_t *pcmInOut, uint32_t sampleCount, uint8_t *adpcmOut, const int16_t coefs[8][2],
+                                EncodePreset preset) {
+        const EncodeSettings &settings = getEncodeSettings(preset);
+        std::array<std::array<int32_t, 16>, 8> inSamples{};
+        std::array<std::array<int32_t, 14>, 8> outSamples{};
+        std::array<int32_t, 8> scale{};
+        std::array<double, 8> totalError{};
+
+        alignas(32) std::array<int32_t, 8> coef0Lanes{}, coef1Lanes{};
+        for (int i = 0; i < 8; i++) {
+            coef0Lanes[i] = coefs[i][0];
+            coef1Lanes[i] = coefs[i][1];
+        }
+        __m256i coef0 = _mm256_load_si256(reinterpret_cast<const __m256i *>(coef0Lanes.data()));
+        __m256i coef1 = _mm256_load_si256(reinterpret_cast<const __m256i *>(coef1Lanes.data()));
+
+        std::array<int32_t, 8> distances = getDistancesAvx2(pcmInOut, sampleCount, coef0, coef1);
+        std::array<bool, 8> active = selectCandidates(distances, settings);
+        for (int i = 0; i < 8; i++) {
+            totalError[i] = active[i] ? 0 : std::numeric_limits<double>::max();
+            scale[i] = getInitialScale(distances[i]);
+            inSamples[i][0] = pcmInOut[0];
+            inSamples[i][1] = pcmInOut[1];
+        }
+
+        /* All lanes run every pass, only the lanes whose search is still going take the results */
+        std::array<std::array<int32_t, 8>, 16> passIn{};
+        std::array<std::array<int32_t, 8>, 14> passOut{};
+        std::array<uint64_t, 8> passError{};
+        std::array<int32_t, 8> passIndex{};
+        while (std::find(active.begin(), active.end(), true) != active.end()) {
+            for (int i = 0; i < 8; i++) {
+                if (active[i]) scale[i]++;
+            }
+            searchPassAvx2(pcmInOut, sampleCount, coef0, coef1, scale, passIn, passOut, passError, passIndex);
+            for (int i = 0; i < 8; i++) {
+                if (!active[i]) continue;
+                totalError[i] = static_cast<double>(passError[i]);
+                for (uint32_t s = 0; s < sampleCount; s++) {
+                    inSamples[i][s + 2] = passIn[s + 2][i];
+                    outSamples[i][s] = passOut[s][i];
+                }
+                active[i] = adjustScale(scale[i], passIndex[i]);
+            }
+        }
+
+        writeBestFrame(pcmInOut, sampleCount, adpcmOut, totalError, scale, inSamples, outSamples);
+    }
+#endif
+
+    void encodeFrame(int16_t *pcmInOut, uint32_t sampleCount, uint8_t *adpcmOut, const int16_t coefs[8][2],
+                     EncodePreset preset) {
+#ifdef DSPADPCM_X86
+        static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+        if (hasAvx2) {
+            encodeFrameAvx2(pcmInOut, sampleCount, adpcmOut, coefs, preset);
+            return;
+        }
+#endif
+        encodeFrameScalar(pcmInOut, sampleCount, adpcmOut, coefs, preset);
+    }
+
+    const char *getFrameSearchIsaName() {
+#ifdef DSPADPCM_X86
+        if (__builtin_cpu_supports("avx2")) return "avx2";
+#endif
+        return "scalar";
+    }
+
+    void encode(const int16_t *src, uint8_t *dst, int16_t &yn1, int16_t &yn2, const int16_t coefs[8][2],
+                uint32_t sampleCount, EncodePreset preset, std::span<HistoryCapture> captures,
+                EncodeMetrics *metrics) {
+        auto capture = captures.begin();
+        std::array<int16_t, 16> pcmBuffer{};
+        std::array<uint8_t, 8> adpcmBuffer{};
+        // Reconstructed samples are collected so the metrics run over longer vectors than one frame
+        std::array<int16_t, 14 * 64> decodedChunk;
+        uint32_t chunkStart = 0, chunkSize = 0;
+
+        pcmBuffer[0] = yn2;
+        pcmBuffer[1] = yn1;
+
+        uint32_t frameCount = (sampleCount + 13) / 14;
+        for (uint32_t frame = 0; frame < frameCount; frame++) {
+            uint32_t samplesToCopy = std::min(sampleCount - frame * 14, 14u);
+            std::copy_n(src + frame * 14, samplesToCopy, &pcmBuffer[2]);
+            std::fill(&pcmBuffer[2 + samplesToCopy], pcmBuffer.end(), 0);
+
+            encodeFrame(pcmBuffer.data(), 14, adpcmBuffer.data(), coefs, preset);
+
+            std::copy_n(adpcmBuffer.begin(), getBytesForSamples(samplesToCopy), dst + frame * 8);
+
+            // pcmBuffer holds the decoded history and samples of this frame, so every position in it is known now
+            for (; capture != captures.end() && capture->sample < frame * 14 + samplesToCopy; ++capture) {
+                uint32_t offset = capture->sample - frame * 14;
+                capture->header = adpcmBuffer[0];
+                capture->yn1 = pcmBuffer[offset + 1];
+                capture->yn2 = pcmBuffer[offset];
+            }
+
+            if (metrics) {
+                std::copy_n(&pcmBuffer[2], samplesToCopy, decodedChunk.begin() + chunkSize);
+                chunkSize += samplesToCopy;
+                if (chunkSize == decodedChunk.size() || frame + 1 == frameCount) {
+                    metrics->accumulate(src + chunkStart, decodedChunk.data(), chunkSize);
+                    chunkStart += chunkSize;
+                    chunkSize = 0;
+                }
+            }
+
+            // The history after a partial frame is the last real sample, not the padding
+            yn2 = pcmBuffer[samplesToCopy];
+            yn1 = pcmBuffer[samplesToCopy + 1];
             pcmBuffer[0] = pcmBuffer[14];
             pcmBuffer[1] = pcmBuffer[15];
-            config.Progress?.ReportAdd(1);
         }
-
-        return adpcm;
-    }*/
+        // Positions at or after the end
+        for (; capture != captures.end(); ++capture) {
+            capture->header = 0;
+            capture->yn1 = yn1;
+            capture->yn2 = yn2;
+        }
+    }
 }
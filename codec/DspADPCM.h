@@ -4,16 +4,110 @@
 
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <span>
+#include <vector>
+#include "SampleConvert.h"
+
+struct EncodeMetrics;
 
 namespace dspadpcm {
     // From citric composer https://github.com/Gota7/Citric-Composer/blob/master/Citric%20Composer/Citric%20Composer/Low%20Level/Stream%20Audio/DspAdpcmDecode.cs
+    // yn1 and yn2 must hold the history at the start of the frame that contains startSample.
     void decode(const uint8_t *src, short *dst, short &yn1, short &yn2, const int16_t coefs[8][2],
                 uint32_t sampleCount, uint32_t startSample);
 
+    // Same as decode, but adds the samples scaled by gain to the interleaved stereo float mix buffer instead of
+    // writing pcm16. No intermediate pcm16 buffer is needed for mixing or downmixing.
+    void decodeMix(const uint8_t *src, float *mix, short &yn1, short &yn2, const int16_t coefs[8][2],
+                   uint32_t sampleCount, uint32_t startSample, sampleconv::StereoGain gain);
+
+    /**
+     * Speed/quality tiers of the encoder. EXHAUSTIVE matches the reference encoder.
+     */
+    enum class EncodePreset : uint8_t {
+        FAST,
+        BALANCED,
+        EXHAUSTIVE
+    };
+
+    struct EncodeSettings {
+        const char *name;
+        // Only every n-th frame is analyzed for the coefficient search
+        uint32_t coefFrameStride;
+        // Refinement passes per split in the coefficient search
+        int refinePasses;
+        // Number of coefficient sets tried for every frame, preselected by the error of the plain prediction
+        uint32_t candidateCoefs;
+    };
+
+    const EncodeSettings &getEncodeSettings(EncodePreset preset);
+
+    constexpr uint32_t getBytesForSamples(uint32_t sampleCount) {
+        uint32_t extra = sampleCount % 14;
+        return sampleCount / 14 * 8 + (extra == 0 ? 0 : 1 + (extra + 1) / 2);
+    }
+
+    /**
+     * Calculates the coefficients of a channel from samples that are added piece by piece, so the channel never has
+     * to be in memory as a whole. Only one frame and the analysis records (3 doubles per frame) are kept.
+     * The result is the same as calculateCoefficients over all samples.
+     */
+    class CoefficientBuilder {
+    public:
+        explicit CoefficientBuilder(EncodePreset preset = EncodePreset::EXHAUSTIVE);
+
+        void add(const int16_t *samples, uint32_t count);
+
+        std::array<int16_t, 16> finish();
+
+    private:
+        void analyzeFrame();
+
+        const EncodeSettings &m_Settings;
+        // The previous frame and then the current one
+        std::array<int16_t, 28> m_PcmHistBuffer{};
+        uint32_t m_FrameFill = 0;
+        uint32_t m_FrameIndex = 0;
+        std::vector<std::array<double, 3>> m_Records;
+    };
+
     // From VG Audio https://github.com/Thealexbarney/VGAudio/blob/master/src/VGAudio/Codecs/GcAdpcm/GcAdpcmCoefficients.cs
-    std::array<int16_t, 16> calculateCoefficients(const int16_t *pcm16samples, uint32_t sampleCount);
+    std::array<int16_t, 16> calculateCoefficients(const int16_t *pcm16samples, uint32_t sampleCount,
+                                                  EncodePreset preset = EncodePreset::EXHAUSTIVE);
 
     // From VG Audio https://github.com/Thealexbarney/VGAudio/blob/master/src/VGAudio/Codecs/GcAdpcm/GcAdpcmEncoder.cs
-    void encode();
+    // pcmInOut holds yn2, yn1 and then the samples of the frame. The samples are replaced by the decoded ones.
+    // The search over the coef sets and scales runs vectorized if the cpu supports it, the result is bit-exact with
+    // encodeFrameScalar.
+    void encodeFrame(int16_t *pcmInOut, uint32_t sampleCount, uint8_t *adpcmOut, const int16_t coefs[8][2],
+                     EncodePreset preset = EncodePreset::EXHAUSTIVE);
+
+    // The reference implementation of encodeFrame
+    void encodeFrameScalar(int16_t *pcmInOut, uint32_t sampleCount, uint8_t *adpcmOut, const int16_t coefs[8][2],
+                           EncodePreset preset = EncodePreset::EXHAUSTIVE);
+
+    /**
+     * @return The name of the instruction set encodeFrame uses
+     */
+    const char *getFrameSearchIsaName();
+
+    /**
+     * Decoder state at a sample position, filled in by encode() when it crosses the position.
+     */
+    struct HistoryCapture {
+        uint32_t sample;
+        // Header (predictor/scale) of the frame that contains the sample
+        uint8_t header;
+        int16_t yn1;
+        int16_t yn2;
+    };
+
+    // yn1 and yn2 hold the history before src and are updated to the decoded history after the last sample.
+    // captures must be sorted by sample, the positions are relative to src.
+    // metrics, if given, accumulates the quality from the reconstructed samples of the encoder.
+    void encode(const int16_t *src, uint8_t *dst, int16_t &yn1, int16_t &yn2, const int16_t coefs[8][2],
+                uint32_t sampleCount, EncodePreset preset = EncodePreset::EXHAUSTIVE,
+                std::span<HistoryCapture> captures = {}, EncodeMetrics *metrics = nullptr);
 };
@@ -0,0 +1,131 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include "EncodeMetrics.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+static bool isClipped(int16_t source, int16_t decoded) {
+    return decoded != source && (decoded == std::numeric_limits<int16_t>::max() ||
+                                 decoded == std::numeric_limits<int16_t>::min());
+}
+
+void EncodeMetrics::accumulate(const int16_t *source, const int16_t *decoded, uint32_t count) {
+    uint32_t i = 0;
+#if defined(__x86_64__) || defined(_M_X64)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max16 = _mm_set1_epi16(std::numeric_limits<int16_t>::max());
+    const __m128i min16 = _mm_set1_epi16(std::numeric_limits<int16_t>::min());
+    __m128i signalAcc = zero, errorAcc = zero, peakAcc = zero;
+    uint32_t clips = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+        __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(decoded + i));
+
+        // Pair sums of squares fit into uint32
+        __m128i signal = _mm_madd_epi16(s, s);
+        signalAcc = _mm_add_epi64(signalAcc, _mm_add_epi64(_mm_unpacklo_epi32(signal, zero),
+                                                           _mm_unpackhi_epi32(signal, zero)));
+
+        // The difference needs 17 bits, its square fits into uint32
+        for (__m128i diff: {_mm_sub_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16),
+                                          _mm_srai_epi32(_mm_unpacklo_epi16(r, r), 16)),
+                            _mm_sub_epi32(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16),
+                                          _mm_srai_epi32(_mm_unpackhi_epi16(r, r), 16))}) {
+            __m128i sign = _mm_srai_epi32(diff, 31);
+            __m128i abs = _mm_sub_epi32(_mm_xor_si128(diff, sign), sign);
+            errorAcc = _mm_add_epi64(errorAcc, _mm_mul_epu32(abs, abs));
+            __m128i odd = _mm_srli_epi64(abs, 32);
+            errorAcc = _mm_add_epi64(errorAcc, _mm_mul_epu32(odd, odd));
+            __m128i greater = _mm_cmpgt_epi32(abs, peakAcc);
+            peakAcc = _mm_or_si128(_mm_and_si128(greater, abs), _mm_andnot_si128(greater, peakAcc));
+        }
+
+        __m128i limit = _mm_or_si128(_mm_cmpeq_epi16(r, max16), _mm_cmpeq_epi16(r, min16));
+        __m128i clipped = _mm_andnot_si128(_mm_cmpeq_epi16(r, s), limit);
+        clips += std::popcount(static_cast<uint32_t>(_mm_movemask_epi8(clipped))) / 2;
+    }
+    alignas(16) uint64_t lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), signalAcc);
+    signalEnergy += lanes[0] + lanes[1];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), errorAcc);
+    errorEnergy += lanes[0] + lanes[1];
+    alignas(16) uint32_t peaks[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(peaks), peakAcc);
+    peakError = std::max({peakError, peaks[0], peaks[1], peaks[2], peaks[3]});
+    clipCount += clips;
+#elif defined(__aarch64__)
+    uint64x2_t signalAcc = vdupq_n_u64(0), errorAcc = vdupq_n_u64(0);
+    uint32x4_t peakAcc = vdupq_n_u32(0);
+    uint16x8_t clipAcc = vdupq_n_u16(0);
+    uint32_t pendingClips = 0;
+    const int16x8_t max16 = vdupq_n_s16(std::numeric_limits<int16_t>::max());
+    const int16x8_t min16 = vdupq_n_s16(std::numeric_limits<int16_t>::min());
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t s = vld1q_s16(source + i);
+        int16x8_t r = vld1q_s16(decoded + i);
+
+        signalAcc = vpadalq_u32(signalAcc, vreinterpretq_u32_s32(vmull_s16(vget_low_s16(s), vget_low_s16(s))));
+        signalAcc = vpadalq_u32(signalAcc, vreinterpretq_u32_s32(vmull_high_s16(s, s)));
+
+        uint32x4_t absLow = vreinterpretq_u32_s32(vabsq_s32(vsubl_s16(vget_low_s16(s), vget_low_s16(r))));
+        uint32x4_t absHigh = vreinterpretq_u32_s32(vabsq_s32(vsubl_high_s16(s, r)));
+        errorAcc = vmlal_u32(errorAcc, vget_low_u32(absLow), vget_low_u32(absLow));
+        errorAcc = vmlal_high_u32(errorAcc, absLow, absLow);
+        errorAcc = vmlal_u32(errorAcc, vget_low_u32(absHigh), vget_low_u32(absHigh));
+        errorAcc = vmlal_high_u32(errorAcc, absHigh, absHigh);
+        peakAcc = vmaxq_u32(peakAcc, vmaxq_u32(absLow, absHigh));
+
+        uint16x8_t limit = vorrq_u16(vceqq_s16(r, max16), vceqq_s16(r, min16));
+        uint16x8_t clipped = vbicq_u16(limit, vceqq_s16(r, s));
+        // Lanes are 0xFFFF when clipped, subtracting counts them. Flushed before the 16 bit lanes can overflow
+        clipAcc = vsubq_u16(clipAcc, clipped);
+        if (++pendingClips == std::numeric_limits<uint16_t>::max()) {
+            pendingClips = 0;
+            clipCount += vaddlvq_u16(clipAcc);
+            clipAcc = vdupq_n_u16(0);
+        }
+    }
+    signalEnergy += vaddvq_u64(signalAcc);
+    errorEnergy += vaddvq_u64(errorAcc);
+    peakError = std::max(peakError, vmaxvq_u32(peakAcc));
+    clipCount += vaddlvq_u16(clipAcc);
+#endif
+    for (; i < count; ++i) {
+        int32_t s = source[i];
+        int32_t diff = s - decoded[i];
+        signalEnergy += static_cast<uint64_t>(s * s);
+        errorEnergy += static_cast<uint64_t>(static_cast<int64_t>(diff) * diff);
+        peakError = std::max(peakError, static_cast<uint32_t>(std::abs(diff)));
+        clipCount += isClipped(source[i], decoded[i]);
+    }
+    sampleCount += count;
+}
+
+void EncodeMetrics::merge(const EncodeMetrics &other) {
+    sampleCount += other.sampleCount;
+    signalEnergy += other.signalEnergy;
+    errorEnergy += other.errorEnergy;
+    peakError = std::max(peakError, other.peakError);
+    clipCount += other.clipCount;
+}
+
+double EncodeMetrics::getSnr() const {
+    if (errorEnergy == 0) return std::numeric_limits<double>::infinity();
+    if (signalEnergy == 0) return -std::numeric_limits<double>::infinity();
+    return 10.0 * std::log10(static_cast<double>(signalEnergy) / static_cast<double>(errorEnergy));
+}
+
+std::ostream &operator<<(std::ostream &os, const EncodeMetrics &obj) {
+    return os << "SNR " << obj.getSnr() << " dB, peak error " << obj.peakError << ", " << obj.clipCount
+              << " clipped of " << obj.sampleCount << " samples";
+}
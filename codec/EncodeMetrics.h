@@ -0,0 +1,29 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+/**
+ * Quality of an encode, accumulated from the source and the reconstructed samples while encoding.
+ */
+struct EncodeMetrics {
+    uint64_t sampleCount = 0;
+    uint64_t signalEnergy = 0;
+    uint64_t errorEnergy = 0;
+    uint32_t peakError = 0;
+    // Reconstructed samples that hit the int16 range limits while the source did not
+    uint64_t clipCount = 0;
+
+    void accumulate(const int16_t *source, const int16_t *decoded, uint32_t count);
+
+    void merge(const EncodeMetrics &other);
+
+    // Infinite if there is no error
+    [[nodiscard]] double getSnr() const;
+
+    friend std::ostream &operator<<(std::ostream &os, const EncodeMetrics &obj);
+};
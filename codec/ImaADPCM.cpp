@@ -0,0 +1,107 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <algorithm>
+#include <array>
+#include "ImaADPCM.h"
+
+static constexpr std::array<int32_t, 89> stepTable{
+        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+        107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+        876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428,
+        4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350,
+        22385, 24623, 27086, 29794, 32767
+};
+
+static constexpr std::array<int8_t, 16> indexTable{-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+// The difference for every (step index, nibble) pair, precomputed like the reference decoder does it bit by bit
+static constexpr auto diffTable = [] {
+    std::array<std::array<int32_t, 16>, 89> table{};
+    for (int i = 0; i < 89; ++i) {
+        int32_t step = stepTable[i];
+        for (int n = 0; n < 16; ++n) {
+            int32_t diff = step >> 3;
+            if (n & 4) diff += step;
+            if (n & 2) diff += step >> 1;
+            if (n & 1) diff += step >> 2;
+            table[i][n] = n & 8 ? -diff : diff;
+        }
+    }
+    return table;
+}();
+
+static constexpr auto nextIndexTable = [] {
+    std::array<std::array<uint8_t, 16>, 89> table{};
+    for (int i = 0; i < 89; ++i) {
+        for (int n = 0; n < 16; ++n) {
+            table[i][n] = static_cast<uint8_t>(std::clamp(i + indexTable[n], 0, 88));
+        }
+    }
+    return table;
+}();
+
+inline int16_t decodeNibble(uint8_t nibble, int32_t &predictor, uint8_t &stepIndex) {
+    predictor = std::clamp(predictor + diffTable[stepIndex][nibble], -32768, 32767);
+    stepIndex = nextIndexTable[stepIndex][nibble];
+    return static_cast<int16_t>(predictor);
+}
+
+namespace imaadpcm {
+    void decode(const uint8_t *src, int16_t *dst, int16_t &predictor, uint8_t &stepIndex, uint32_t sampleCount,
+                uint32_t startSample) {
+        int32_t pred = predictor;
+        uint8_t index = std::min<uint8_t>(stepIndex, 88);
+        // Samples that are skipped
+        for (uint32_t i = 0; i < startSample; ++i) {
+            decodeNibble(src[i >> 1] >> ((i & 1) << 2) & 0xF, pred, index);
+        }
+        uint32_t i = startSample;
+        uint32_t end = startSample + sampleCount;
+        if (i & 1 && i < end) {
+            *dst++ = decodeNibble(src[i >> 1] >> 4, pred, index);
+            ++i;
+        }
+        for (; i + 1 < end; i += 2) {
+            uint8_t byte = src[i >> 1];
+            *dst++ = decodeNibble(byte & 0xF, pred, index);
+            *dst++ = decodeNibble(byte >> 4, pred, index);
+        }
+        if (i < end) {
+            *dst = decodeNibble(src[i >> 1] & 0xF, pred, index);
+        }
+        predictor = static_cast<int16_t>(pred);
+        stepIndex = index;
+    }
+
+    void decodeMulti(const uint8_t *const *src, int16_t *const *dst, int16_t *predictors, uint8_t *stepIndices,
+                     uint32_t channelNum, uint32_t sampleCount) {
+        // Process the channels in groups so the states stay in registers
+        constexpr uint32_t groupSize = 4;
+        for (uint32_t first = 0; first < channelNum; first += groupSize) {
+            uint32_t count = std::min(groupSize, channelNum - first);
+            std::array<int32_t, groupSize> pred{};
+            std::array<uint8_t, groupSize> index{};
+            for (uint32_t c = 0; c < count; ++c) {
+                pred[c] = predictors[first + c];
+                index[c] = std::min<uint8_t>(stepIndices[first + c], 88);
+            }
+            uint32_t byteCount = sampleCount / 2;
+            for (uint32_t b = 0; b < byteCount; ++b) {
+                for (uint32_t c = 0; c < count; ++c) {
+                    uint8_t byte = src[first + c][b];
+                    dst[first + c][b * 2] = decodeNibble(byte & 0xF, pred[c], index[c]);
+                    dst[first + c][b * 2 + 1] = decodeNibble(byte >> 4, pred[c], index[c]);
+                }
+            }
+            for (uint32_t c = 0; c < count; ++c) {
+                if (sampleCount & 1) {
+                    dst[first + c][sampleCount - 1] = decodeNibble(src[first + c][byteCount] & 0xF, pred[c], index[c]);
+                }
+                predictors[first + c] = static_cast<int16_t>(pred[c]);
+                stepIndices[first + c] = index[c];
+            }
+        }
+    }
+}
@@ -0,0 +1,24 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+
+namespace imaadpcm {
+    /**
+     * Decodes 4 bit IMA-ADPCM, low nibble first. The samples before startSample are decoded but not written.
+     * @param predictor The predictor at the start of src, updated to the state after the last decoded sample
+     * @param stepIndex The step table index at the start of src, updated like predictor
+     */
+    void decode(const uint8_t *src, int16_t *dst, int16_t &predictor, uint8_t &stepIndex, uint32_t sampleCount,
+                uint32_t startSample);
+
+    /**
+     * Decodes multiple channels of the same length at once. The independent channels are interleaved per byte so
+     * their dependency chains overlap.
+     */
+    void decodeMulti(const uint8_t *const *src, int16_t *const *dst, int16_t *predictors, uint8_t *stepIndices,
+                     uint32_t channelNum, uint32_t sampleCount);
+}
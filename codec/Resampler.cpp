@@ -0,0 +1,146 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <cmath>
+#include <numbers>
+#include <numeric>
+#include "Resampler.h"
+#include "SampleConvert.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Modified bessel function of the first kind for the kaiser window
+static double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// count must be a multiple of 8
+static float dot(const float *a, const float *b, uint32_t count) {
+#if defined(__x86_64__) || defined(_M_X64)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (uint32_t i = 0; i < count; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+    return _mm_cvtss_f32(acc0);
+#elif defined(__aarch64__)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (uint32_t i = 0; i < count; i += 8) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    return vaddvq_f32(vaddq_f32(acc0, acc1));
+#else
+    float sum = 0.0f;
+    for (uint32_t i = 0; i < count; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+#endif
+}
+
+Resampler::Resampler(uint32_t inRate, uint32_t outRate, uint32_t channelNum, uint32_t tapsPerPhase) :
+        m_InRate(inRate), m_OutRate(outRate), m_ChannelNum(channelNum) {
+    m_Taps = std::max(8u, (tapsPerPhase + 7) / 8 * 8);
+    uint32_t divisor = std::gcd(inRate, outRate);
+    m_Up = outRate / divisor;
+    m_Down = inRate / divisor;
+
+    // Cut off slightly below the lower nyquist frequency
+    const double cutoff = 0.95 * std::min(1.0, static_cast<double>(m_Up) / m_Down);
+    const double beta = 8.0;
+    const double halfWidth = m_Taps / 2.0;
+    m_Filter.resize(static_cast<size_t>(m_Up) * m_Taps);
+    for (uint32_t p = 0; p < m_Up; ++p) {
+        float *phase = &m_Filter[p * m_Taps];
+        double sum = 0.0;
+        for (uint32_t j = 0; j < m_Taps; ++j) {
+            // Distance of the input sample to the output position in input samples
+            double t = static_cast<double>(j) - halfWidth + 1.0 - static_cast<double>(p) / m_Up;
+            double x = cutoff * t;
+            double sinc = x == 0.0 ? 1.0 : std::sin(std::numbers::pi * x) / (std::numbers::pi * x);
+            double r = t / halfWidth;
+            double window = std::abs(r) >= 1.0 ? 0.0 : besselI0(beta * std::sqrt(1.0 - r * r)) / besselI0(beta);
+            phase[j] = static_cast<float>(cutoff * sinc * window);
+            sum += phase[j];
+        }
+        // Normalize every phase for unity gain at dc
+        for (uint32_t j = 0; j < m_Taps; ++j) {
+            phase[j] = static_cast<float>(phase[j] / sum);
+        }
+    }
+    m_History.resize(channelNum);
+    m_Output.resize(channelNum);
+    reset();
+}
+
+void Resampler::reset() {
+    for (auto &history: m_History) {
+        // Silence before the first sample so the first output is centered on it
+        history.assign(m_Taps / 2 - 1, 0.0f);
+    }
+    m_Pos = 0;
+    m_Phase = 0;
+}
+
+size_t Resampler::getMaxOutputFrames(size_t inFrames) const {
+    return (m_History[0].size() + inFrames + m_Taps) * m_Up / m_Down + 1;
+}
+
+size_t Resampler::process(const int16_t *const *in, size_t inFrames, int16_t *const *out) {
+    size_t buffered = m_History[0].size();
+    for (uint32_t ch = 0; ch < m_ChannelNum; ++ch) {
+        m_History[ch].resize(buffered + inFrames);
+        sampleconv::s16ToF32(in[ch], m_History[ch].data() + buffered, inFrames);
+    }
+    buffered += inFrames;
+
+    size_t maxFrames = getMaxOutputFrames(inFrames);
+    for (auto &output: m_Output) {
+        if (output.size() < maxFrames) output.resize(maxFrames);
+    }
+    size_t produced = 0;
+    while (m_Pos + m_Taps <= buffered) {
+        const float *taps = &m_Filter[m_Phase * m_Taps];
+        for (uint32_t ch = 0; ch < m_ChannelNum; ++ch) {
+            m_Output[ch][produced] = dot(taps, m_History[ch].data() + m_Pos, m_Taps);
+        }
+        ++produced;
+        m_Phase += m_Down;
+        m_Pos += m_Phase / m_Up;
+        m_Phase %= m_Up;
+    }
+
+    for (uint32_t ch = 0; ch < m_ChannelNum; ++ch) {
+        sampleconv::f32ToS16(m_Output[ch].data(), out[ch], produced);
+        // Keep only what the next outputs still need
+        size_t consumed = std::min(m_Pos, buffered);
+        m_History[ch].erase(m_History[ch].begin(), m_History[ch].begin() + consumed);
+    }
+    m_Pos -= std::min(m_Pos, buffered);
+    return produced;
+}
+
+size_t Resampler::flush(int16_t *const *out) {
+    std::vector<int16_t> silence(m_Taps / 2, 0);
+    std::vector<const int16_t *> in(m_ChannelNum, silence.data());
+    size_t produced = process(in.data(), silence.size(), out);
+    reset();
+    return produced;
+}
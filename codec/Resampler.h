@@ -0,0 +1,61 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Streaming polyphase resampler with a windowed sinc (Kaiser) filter. The ratio is exact (reduced outRate / inRate),
+ * the state is kept across process() calls, so blocks can be fed one after another without clicks.
+ */
+class Resampler {
+public:
+    /**
+     * @param tapsPerPhase Filter length in input samples, rounded up to a multiple of 8. More taps are sharper but slower.
+     */
+    Resampler(uint32_t inRate, uint32_t outRate, uint32_t channelNum, uint32_t tapsPerPhase = 32);
+
+    /**
+     * Resamples planar pcm16 data.
+     * @param out One buffer per channel with space for at least getMaxOutputFrames(inFrames) frames
+     * @return The number of frames written to out
+     */
+    size_t process(const int16_t *const *in, size_t inFrames, int16_t *const *out);
+
+    /**
+     * Writes the frames still held back by the filter at the end of a stream.
+     * @param out One buffer per channel with space for at least getMaxOutputFrames(0) frames
+     */
+    size_t flush(int16_t *const *out);
+
+    void reset();
+
+    [[nodiscard]] size_t getMaxOutputFrames(size_t inFrames) const;
+
+    [[nodiscard]] uint32_t getInRate() const {
+        return m_InRate;
+    }
+
+    [[nodiscard]] uint32_t getOutRate() const {
+        return m_OutRate;
+    }
+
+private:
+    uint32_t m_InRate;
+    uint32_t m_OutRate;
+    uint32_t m_ChannelNum;
+    uint32_t m_Taps;
+    // Interpolation (L) and decimation (M) factor
+    uint32_t m_Up;
+    uint32_t m_Down;
+    // m_Up phases with m_Taps coefficients each
+    std::vector<float> m_Filter;
+    std::vector<std::vector<float>> m_History;
+    std::vector<std::vector<float>> m_Output;
+    size_t m_Pos = 0;
+    uint32_t m_Phase = 0;
+};
@@ -0,0 +1,677 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include "SampleConvert.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SAMPLECONV_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define SAMPLECONV_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+    // Gain of sample i is from + step * i, already divided by 32768
+    struct Ramp {
+        float fromLeft;
+        float fromRight;
+        float stepLeft;
+        float stepRight;
+    };
+
+    struct Kernels {
+        const char *name;
+
+        void (*s8ToS16)(const int8_t *, int16_t *, size_t);
+
+        void (*s16ToS32)(const int16_t *, int32_t *, size_t);
+
+        void (*s32ToS16)(const int32_t *, int16_t *, size_t);
+
+        void (*s16ToF32)(const int16_t *, float *, size_t, float);
+
+        void (*f32ToS16)(const float *, int16_t *, size_t, float);
+
+        void (*bswapS16)(const int16_t *, int16_t *, size_t);
+
+        // Mixes the samples [begin, end)
+        void (*mixS16)(const int16_t *, float *, float *, size_t, size_t, const Ramp &);
+    };
+
+    // The scalar versions also handle the tails of the vectorized ones
+
+    void s8ToS16Scalar(const int8_t *src, int16_t *dst, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = static_cast<int16_t>(src[i] * 256);
+        }
+    }
+
+    void s16ToS32Scalar(const int16_t *src, int32_t *dst, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = src[i] * 65536;
+        }
+    }
+
+    void s32ToS16Scalar(const int32_t *src, int16_t *dst, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = static_cast<int16_t>(src[i] >> 16);
+        }
+    }
+
+    void s16ToF32Scalar(const int16_t *src, float *dst, size_t count, float gain) {
+        const float scale = gain / 32768.0f;
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = static_cast<float>(src[i]) * scale;
+        }
+    }
+
+    void f32ToS16Scalar(const float *src, int16_t *dst, size_t count, float gain) {
+        const float scale = gain * 32768.0f;
+        for (size_t i = 0; i < count; ++i) {
+            float v = std::clamp(src[i] * scale, -32768.0f, 32767.0f);
+            // Round to nearest even like the vector units do
+            dst[i] = static_cast<int16_t>(std::nearbyint(v));
+        }
+    }
+
+    void bswapS16Scalar(const int16_t *src, int16_t *dst, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = static_cast<int16_t>(__builtin_bswap16(static_cast<uint16_t>(src[i])));
+        }
+    }
+
+    void mixS16Scalar(const int16_t *src, float *left, float *right, size_t begin, size_t end, const Ramp &ramp) {
+        for (size_t i = begin; i < end; ++i) {
+            auto index = static_cast<float>(i);
+            auto sample = static_cast<float>(src[i]);
+            left[i] += sample * (ramp.fromLeft + ramp.stepLeft * index);
+            right[i] += sample * (ramp.fromRight + ramp.stepRight * index);
+        }
+    }
+
+    constexpr Kernels scalarKernels{"scalar", s8ToS16Scalar, s16ToS32Scalar, s32ToS16Scalar, s16ToF32Scalar,
+                                    f32ToS16Scalar, bswapS16Scalar, mixS16Scalar};
+
+#ifdef SAMPLECONV_X86
+    // SSE2 is always available on x86-64
+
+    void s8ToS16Sse2(const int8_t *src, int16_t *dst, size_t count) {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            // Putting the byte into the high half is the same as shifting left by 8
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_unpacklo_epi8(zero, v));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 8), _mm_unpackhi_epi8(zero, v));
+        }
+        s8ToS16Scalar(src + i, dst + i, count - i);
+    }
+
+    void s16ToS32Sse2(const int16_t *src, int32_t *dst, size_t count) {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_unpacklo_epi16(zero, v));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 4), _mm_unpackhi_epi16(zero, v));
+        }
+        s16ToS32Scalar(src + i, dst + i, count - i);
+    }
+
+    void s32ToS16Sse2(const int32_t *src, int16_t *dst, size_t count) {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i lo = _mm_srai_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), 16);
+            __m128i hi = _mm_srai_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 4)), 16);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packs_epi32(lo, hi));
+        }
+        s32ToS16Scalar(src + i, dst + i, count - i);
+    }
+
+    void s16ToF32Sse2(const int16_t *src, float *dst, size_t count, float gain) {
+        const __m128 scale = _mm_set1_ps(gain / 32768.0f);
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(zero, v), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(zero, v), 16);
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+            _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+        }
+        s16ToF32Scalar(src + i, dst + i, count - i, gain);
+    }
+
+    void f32ToS16Sse2(const float *src, int16_t *dst, size_t count, float gain) {
+        const __m128 scale = _mm_set1_ps(gain * 32768.0f);
+        const __m128 min = _mm_set1_ps(-32768.0f);
+        const __m128 max = _mm_set1_ps(32767.0f);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128 lo = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+            __m128 hi = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+            // Clamp first, out of range floats would convert to INT_MIN
+            lo = _mm_min_ps(_mm_max_ps(lo, min), max);
+            hi = _mm_min_ps(_mm_max_ps(hi, min), max);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                             _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+        }
+        f32ToS16Scalar(src + i, dst + i, count - i, gain);
+    }
+
+    void bswapS16Sse2(const int16_t *src, int16_t *dst, size_t count) {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_or_si128(_mm_slli_epi16(v, 8),
+                                                                                _mm_srli_epi16(v, 8)));
+        }
+        bswapS16Scalar(src + i, dst + i, count - i);
+    }
+
+    void mixS16Sse2(const int16_t *src, float *left, float *right, size_t begin, size_t end, const Ramp &ramp) {
+        const __m128 fromLeft = _mm_set1_ps(ramp.fromLeft);
+        const __m128 fromRight = _mm_set1_ps(ramp.fromRight);
+        const __m128 stepLeft = _mm_set1_ps(ramp.stepLeft);
+        const __m128 stepRight = _mm_set1_ps(ramp.stepRight);
+        const __m128 lanes = _mm_setr_ps(0, 1, 2, 3);
+        const __m128 four = _mm_set1_ps(4);
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            __m128 samples[2]{_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(zero, v), 16)),
+                              _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(zero, v), 16))};
+            __m128 index = _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lanes);
+            for (int h = 0; h < 2; ++h, index = _mm_add_ps(index, four)) {
+                __m128 gainLeft = _mm_add_ps(fromLeft, _mm_mul_ps(stepLeft, index));
+                __m128 gainRight = _mm_add_ps(fromRight, _mm_mul_ps(stepRight, index));
+                float *l = left + i + h * 4;
+                float *r = right + i + h * 4;
+                _mm_storeu_ps(l, _mm_add_ps(_mm_loadu_ps(l), _mm_mul_ps(samples[h], gainLeft)));
+                _mm_storeu_ps(r, _mm_add_ps(_mm_loadu_ps(r), _mm_mul_ps(samples[h], gainRight)));
+            }
+        }
+        mixS16Scalar(src, left, right, i, end, ramp);
+    }
+
+    constexpr Kernels sse2Kernels{"sse2", s8ToS16Sse2, s16ToS32Sse2, s32ToS16Sse2, s16ToF32Sse2, f32ToS16Sse2,
+                                  bswapS16Sse2, mixS16Sse2};
+
+    __attribute__((target("avx2"))) void s8ToS16Avx2(const int8_t *src, int16_t *dst, size_t count) {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m256i v = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_slli_epi16(v, 8));
+        }
+        s8ToS16Scalar(src + i, dst + i, count - i);
+    }
+
+    __attribute__((target("avx2"))) void s16ToS32Avx2(const int16_t *src, int32_t *dst, size_t count) {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_slli_epi32(v, 16));
+        }
+        s16ToS32Scalar(src + i, dst + i, count - i);
+    }
+
+    __attribute__((target("avx2"))) void s32ToS16Avx2(const int32_t *src, int16_t *dst, size_t count) {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m256i lo = _mm256_srai_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i)), 16);
+            __m256i hi = _mm256_srai_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 8)), 16);
+            // packs works per 128 bit lane, the permute restores the sample order
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+        }
+        s32ToS16Scalar(src + i, dst + i, count - i);
+    }
+
+    __attribute__((target("avx2"))) void s16ToF32Avx2(const int16_t *src, float *dst, size_t count, float gain) {
+        const __m256 scale = _mm256_set1_ps(gain / 32768.0f);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+            _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+        }
+        s16ToF32Scalar(src + i, dst + i, count - i, gain);
+    }
+
+    __attribute__((target("avx2"))) void f32ToS16Avx2(const float *src, int16_t *dst, size_t count, float gain) {
+        const __m256 scale = _mm256_set1_ps(gain * 32768.0f);
+        const __m256 min = _mm256_set1_ps(-32768.0f);
+        const __m256 max = _mm256_set1_ps(32767.0f);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m256 lo = _mm256_mul_ps(_mm256_loadu_ps(src + i), scale);
+            __m256 hi = _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale);
+            lo = _mm256_min_ps(_mm256_max_ps(lo, min), max);
+            hi = _mm256_min_ps(_mm256_max_ps(hi, min), max);
+            __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(lo), _mm256_cvtps_epi32(hi));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_permute4x64_epi64(packed, 0xD8));
+        }
+        f32ToS16Scalar(src + i, dst + i, count - i, gain);
+    }
+
+    __attribute__((target("avx2"))) void bswapS16Avx2(const int16_t *src, int16_t *dst, size_t count) {
+        const __m256i mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                              1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_shuffle_epi8(v, mask));
+        }
+        bswapS16Scalar(src + i, dst + i, count - i);
+    }
+
+    __attribute__((target("avx2"))) void mixS16Avx2(const int16_t *src, float *left, float *right, size_t begin,
+                                                     size_t end, const Ramp &ramp) {
+        const __m256 fromLeft = _mm256_set1_ps(ramp.fromLeft);
+        const __m256 fromRight = _mm256_set1_ps(ramp.fromRight);
+        const __m256 stepLeft = _mm256_set1_ps(ramp.stepLeft);
+        const __m256 stepRight = _mm256_set1_ps(ramp.stepRight);
+        const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+            __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+            __m256 samples = _mm256_cvtepi32_ps(v);
+            __m256 index = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), lanes);
+            // No fma, so the result matches the other kernels
+            __m256 gainLeft = _mm256_add_ps(fromLeft, _mm256_mul_ps(stepLeft, index));
+            __m256 gainRight = _mm256_add_ps(fromRight, _mm256_mul_ps(stepRight, index));
+            _mm256_storeu_ps(left + i, _mm256_add_ps(_mm256_loadu_ps(left + i), _mm256_mul_ps(samples, gainLeft)));
+            _mm256_storeu_ps(right + i, _mm256_add_ps(_mm256_loadu_ps(right + i), _mm256_mul_ps(samples, gainRight)));
+        }
+        mixS16Scalar(src, left, right, i, end, ramp);
+    }
+
+    constexpr Kernels avx2Kernels{"avx2", s8ToS16Avx2, s16ToS32Avx2, s32ToS16Avx2, s16ToF32Avx2, f32ToS16Avx2,
+                                  bswapS16Avx2, mixS16Avx2};
+#endif
+
+#ifdef SAMPLECONV_NEON
+    void s8ToS16Neon(const int8_t *src, int16_t *dst, size_t count) {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            int8x16_t v = vld1q_s8(src + i);
+            vst1q_s16(dst + i, vshll_n_s8(vget_low_s8(v), 8));
+            vst1q_s16(dst + i + 8, vshll_n_s8(vget_high_s8(v), 8));
+        }
+        s8ToS16Scalar(src + i, dst + i, count - i);
+    }
+
+    void s16ToS32Neon(const int16_t *src, int32_t *dst, size_t count) {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            int16x8_t v = vld1q_s16(src + i);
+            vst1q_s32(dst + i, vshll_n_s16(vget_low_s16(v), 16));
+            vst1q_s32(dst + i + 4, vshll_n_s16(vget_high_s16(v), 16));
+        }
+        s16ToS32Scalar(src + i, dst + i, count - i);
+    }
+
+    void s32ToS16Neon(const int32_t *src, int16_t *dst, size_t count) {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            int16x4_t lo = vshrn_n_s32(vld1q_s32(src + i), 16);
+            int16x4_t hi = vshrn_n_s32(vld1q_s32(src + i + 4), 16);
+            vst1q_s16(dst + i, vcombine_s16(lo, hi));
+        }
+        s32ToS16Scalar(src + i, dst + i, count - i);
+    }
+
+    void s16ToF32Neon(const int16_t *src, float *dst, size_t count, float gain) {
+        const float32x4_t scale = vdupq_n_f32(gain / 32768.0f);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            int16x8_t v = vld1q_s16(src + i);
+            vst1q_f32(dst + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+            vst1q_f32(dst + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+        }
+        s16ToF32Scalar(src + i, dst + i, count - i, gain);
+    }
+
+    void f32ToS16Neon(const float *src, int16_t *dst, size_t count, float gain) {
+        const float32x4_t scale = vdupq_n_f32(gain * 32768.0f);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            // vcvtn saturates to int32 and vqmovn to int16
+            int32x4_t lo = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(src + i), scale));
+            int32x4_t hi = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(src + i + 4), scale));
+            vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+        }
+        f32ToS16Scalar(src + i, dst + i, count - i, gain);
+    }
+
+    void bswapS16Neon(const int16_t *src, int16_t *dst, size_t count) {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(src + i));
+            vst1q_u8(reinterpret_cast<uint8_t *>(dst + i), vrev16q_u8(v));
+        }
+        bswapS16Scalar(src + i, dst + i, count - i);
+    }
+
+    void mixS16Neon(const int16_t *src, float *left, float *right, size_t begin, size_t end, const Ramp &ramp) {
+        const float32x4_t fromLeft = vdupq_n_f32(ramp.fromLeft);
+        const float32x4_t fromRight = vdupq_n_f32(ramp.fromRight);
+        const float32x4_t four = vdupq_n_f32(4);
+        const float laneValues[4]{0, 1, 2, 3};
+        const float32x4_t lanes = vld1q_f32(laneValues);
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+            int16x8_t v = vld1q_s16(src + i);
+            float32x4_t samples[2]{vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))),
+                                   vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)))};
+            float32x4_t index = vaddq_f32(vdupq_n_f32(static_cast<float>(i)), lanes);
+            for (int h = 0; h < 2; ++h, index = vaddq_f32(index, four)) {
+                // Separate multiply and add, so the result matches the other kernels
+                float32x4_t gainLeft = vaddq_f32(fromLeft, vmulq_n_f32(index, ramp.stepLeft));
+                float32x4_t gainRight = vaddq_f32(fromRight, vmulq_n_f32(index, ramp.stepRight));
+                float *l = left + i + h * 4;
+                float *r = right + i + h * 4;
+                vst1q_f32(l, vaddq_f32(vld1q_f32(l), vmulq_f32(samples[h], gainLeft)));
+                vst1q_f32(r, vaddq_f32(vld1q_f32(r), vmulq_f32(samples[h], gainRight)));
+            }
+        }
+        mixS16Scalar(src, left, right, i, end, ramp);
+    }
+
+    constexpr Kernels neonKernels{"neon", s8ToS16Neon, s16ToS32Neon, s32ToS16Neon, s16ToF32Neon, f32ToS16Neon,
+                                  bswapS16Neon, mixS16Neon};
+#endif
+
+    // Interleaving only needs the baseline instruction sets, so it is not dispatched at runtime.
+    // The fixed channel versions let the compiler unroll the channel loop, they also handle the tails.
+
+    template<uint32_t Channels>
+    void interleaveFixed(const int16_t *const *src, int16_t *dst, size_t begin, size_t frames) {
+        for (size_t i = begin; i < frames; ++i) {
+            for (uint32_t c = 0; c < Channels; ++c) {
+                dst[i * Channels + c] = src[c][i];
+            }
+        }
+    }
+
+    template<uint32_t Channels>
+    void deinterleaveFixed(const int16_t *src, int16_t *const *dst, size_t begin, size_t frames) {
+        for (size_t i = begin; i < frames; ++i) {
+            for (uint32_t c = 0; c < Channels; ++c) {
+                dst[c][i] = src[i * Channels + c];
+            }
+        }
+    }
+
+#ifdef SAMPLECONV_X86
+    void transpose8x8(__m128i *r) {
+        __m128i t[8], u[8];
+        for (int i = 0; i < 4; ++i) {
+            t[i * 2] = _mm_unpacklo_epi16(r[i * 2], r[i * 2 + 1]);
+            t[i * 2 + 1] = _mm_unpackhi_epi16(r[i * 2], r[i * 2 + 1]);
+        }
+        for (int i = 0; i < 2; ++i) {
+            u[i * 4] = _mm_unpacklo_epi32(t[i * 4], t[i * 4 + 2]);
+            u[i * 4 + 1] = _mm_unpackhi_epi32(t[i * 4], t[i * 4 + 2]);
+            u[i * 4 + 2] = _mm_unpacklo_epi32(t[i * 4 + 1], t[i * 4 + 3]);
+            u[i * 4 + 3] = _mm_unpackhi_epi32(t[i * 4 + 1], t[i * 4 + 3]);
+        }
+        for (int i = 0; i < 4; ++i) {
+            r[i * 2] = _mm_unpacklo_epi64(u[i], u[i + 4]);
+            r[i * 2 + 1] = _mm_unpackhi_epi64(u[i], u[i + 4]);
+        }
+    }
+
+    // Even and odd samples of a, b. The values are sign extended first, so packs never saturates.
+    __m128i evenS16(__m128i a, __m128i b) {
+        return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+    }
+
+    __m128i oddS16(__m128i a, __m128i b) {
+        return _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+    }
+#endif
+
+    void interleave2(const int16_t *const *src, int16_t *dst, size_t frames) {
+        size_t i = 0;
+#ifdef SAMPLECONV_X86
+        for (; i + 8 <= frames; i += 8) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[0] + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[1] + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 2), _mm_unpacklo_epi16(a, b));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 2 + 8), _mm_unpackhi_epi16(a, b));
+        }
+#elif defined(SAMPLECONV_NEON)
+        for (; i + 8 <= frames; i += 8) {
+            vst2q_s16(dst + i * 2, (int16x8x2_t{vld1q_s16(src[0] + i), vld1q_s16(src[1] + i)}));
+        }
+#endif
+        interleaveFixed<2>(src, dst, i, frames);
+    }
+
+    void interleave4(const int16_t *const *src, int16_t *dst, size_t frames) {
+        size_t i = 0;
+#ifdef SAMPLECONV_X86
+        for (; i + 8 <= frames; i += 8) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[0] + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[1] + i));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[2] + i));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[3] + i));
+            __m128i abLo = _mm_unpacklo_epi16(a, b);
+            __m128i abHi = _mm_unpackhi_epi16(a, b);
+            __m128i cdLo = _mm_unpacklo_epi16(c, d);
+            __m128i cdHi = _mm_unpackhi_epi16(c, d);
+            auto *out = reinterpret_cast<__m128i *>(dst + i * 4);
+            _mm_storeu_si128(out, _mm_unpacklo_epi32(abLo, cdLo));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi32(abLo, cdLo));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi32(abHi, cdHi));
+            _mm_storeu_si128(out + 3, _mm_unpackhi_epi32(abHi, cdHi));
+        }
+#elif defined(SAMPLECONV_NEON)
+        for (; i + 8 <= frames; i += 8) {
+            vst4q_s16(dst + i * 4, (int16x8x4_t{vld1q_s16(src[0] + i), vld1q_s16(src[1] + i),
+                                                vld1q_s16(src[2] + i), vld1q_s16(src[3] + i)}));
+        }
+#endif
+        interleaveFixed<4>(src, dst, i, frames);
+    }
+
+    void interleave8(const int16_t *const *src, int16_t *dst, size_t frames) {
+        size_t i = 0;
+#ifdef SAMPLECONV_X86
+        for (; i + 8 <= frames; i += 8) {
+            __m128i r[8];
+            for (int c = 0; c < 8; ++c) {
+                r[c] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[c] + i));
+            }
+            transpose8x8(r);
+            for (int f = 0; f < 8; ++f) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + (i + f) * 8), r[f]);
+            }
+        }
+#endif
+        interleaveFixed<8>(src, dst, i, frames);
+    }
+
+    void deinterleave2(const int16_t *src, int16_t *const *dst, size_t frames) {
+        size_t i = 0;
+#ifdef SAMPLECONV_X86
+        for (; i + 8 <= frames; i += 8) {
+            __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2));
+            __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2 + 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[0] + i), evenS16(v0, v1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[1] + i), oddS16(v0, v1));
+        }
+#elif defined(SAMPLECONV_NEON)
+        for (; i + 8 <= frames; i += 8) {
+            int16x8x2_t v = vld2q_s16(src + i * 2);
+            vst1q_s16(dst[0] + i, v.val[0]);
+            vst1q_s16(dst[1] + i, v.val[1]);
+        }
+#endif
+        deinterleaveFixed<2>(src, dst, i, frames);
+    }
+
+    void deinterleave4(const int16_t *src, int16_t *const *dst, size_t frames) {
+        size_t i = 0;
+#ifdef SAMPLECONV_X86
+        for (; i + 8 <= frames; i += 8) {
+            auto *in = reinterpret_cast<const __m128i *>(src + i * 4);
+            __m128i v0 = _mm_loadu_si128(in);
+            __m128i v1 = _mm_loadu_si128(in + 1);
+            __m128i v2 = _mm_loadu_si128(in + 2);
+            __m128i v3 = _mm_loadu_si128(in + 3);
+            // Channels 0 and 2 are on even positions, 1 and 3 on odd positions
+            __m128i even01 = evenS16(v0, v1);
+            __m128i even23 = evenS16(v2, v3);
+            __m128i odd01 = oddS16(v0, v1);
+            __m128i odd23 = oddS16(v2, v3);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[0] + i), evenS16(even01, even23));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[1] + i), evenS16(odd01, odd23));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[2] + i), oddS16(even01, even23));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[3] + i), oddS16(odd01, odd23));
+        }
+#elif defined(SAMPLECONV_NEON)
+        for (; i + 8 <= frames; i += 8) {
+            int16x8x4_t v = vld4q_s16(src + i * 4);
+            for (int c = 0; c < 4; ++c) {
+                vst1q_s16(dst[c] + i, v.val[c]);
+            }
+        }
+#endif
+        deinterleaveFixed<4>(src, dst, i, frames);
+    }
+
+    void deinterleave8(const int16_t *src, int16_t *const *dst, size_t frames) {
+        size_t i = 0;
+#ifdef SAMPLECONV_X86
+        for (; i + 8 <= frames; i += 8) {
+            __m128i r[8];
+            for (int f = 0; f < 8; ++f) {
+                r[f] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + (i + f) * 8));
+            }
+            transpose8x8(r);
+            for (int c = 0; c < 8; ++c) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[c] + i), r[c]);
+            }
+        }
+#endif
+        deinterleaveFixed<8>(src, dst, i, frames);
+    }
+
+    const Kernels &selectKernels() {
+#ifdef SAMPLECONV_X86
+        if (__builtin_cpu_supports("avx2")) return avx2Kernels;
+        return sse2Kernels;
+#elif defined(SAMPLECONV_NEON)
+        return neonKernels;
+#else
+        return scalarKernels;
+#endif
+    }
+
+    const Kernels &kernels() {
+        static const Kernels &selected = selectKernels();
+        return selected;
+    }
+}
+
+namespace sampleconv {
+    StereoGain getPanGain(float gain, float pan) {
+        float angle = (std::clamp(pan, -1.0f, 1.0f) + 1.0f) * std::numbers::pi_v<float> / 4.0f;
+        return {gain * std::cos(angle), gain * std::sin(angle)};
+    }
+
+    void s8ToS16(const int8_t *src, int16_t *dst, size_t count) {
+        kernels().s8ToS16(src, dst, count);
+    }
+
+    void s16ToS32(const int16_t *src, int32_t *dst, size_t count) {
+        kernels().s16ToS32(src, dst, count);
+    }
+
+    void s32ToS16(const int32_t *src, int16_t *dst, size_t count) {
+        kernels().s32ToS16(src, dst, count);
+    }
+
+    void s16ToF32(const int16_t *src, float *dst, size_t count, float gain) {
+        kernels().s16ToF32(src, dst, count, gain);
+    }
+
+    void f32ToS16(const float *src, int16_t *dst, size_t count, float gain) {
+        kernels().f32ToS16(src, dst, count, gain);
+    }
+
+    void bswapS16(const int16_t *src, int16_t *dst, size_t count) {
+        kernels().bswapS16(src, dst, count);
+    }
+
+    void mixS16(const int16_t *src, float *left, float *right, size_t count, StereoGain from, StereoGain to) {
+        if (count == 0) return;
+        constexpr float scale = 1.0f / 32768.0f;
+        const Ramp ramp{from.left * scale, from.right * scale, (to.left - from.left) * scale / static_cast<float>(count),
+                        (to.right - from.right) * scale / static_cast<float>(count)};
+        kernels().mixS16(src, left, right, 0, count, ramp);
+    }
+
+    void interleaveS16(const int16_t *const *src, int16_t *dst, uint32_t channelNum, size_t frames) {
+        switch (channelNum) {
+            case 1:
+                std::copy_n(src[0], frames, dst);
+                break;
+            case 2:
+                interleave2(src, dst, frames);
+                break;
+            case 4:
+                interleave4(src, dst, frames);
+                break;
+            case 6:
+                interleaveFixed<6>(src, dst, 0, frames);
+                break;
+            case 8:
+                interleave8(src, dst, frames);
+                break;
+            default:
+                for (size_t i = 0; i < frames; ++i) {
+                    for (uint32_t c = 0; c < channelNum; ++c) {
+                        dst[i * channelNum + c] = src[c][i];
+                    }
+                }
+        }
+    }
+
+    void deinterleaveS16(const int16_t *src, int16_t *const *dst, uint32_t channelNum, size_t frames) {
+        switch (channelNum) {
+            case 1:
+                std::copy_n(src, frames, dst[0]);
+                break;
+            case 2:
+                deinterleave2(src, dst, frames);
+                break;
+            case 4:
+                deinterleave4(src, dst, frames);
+                break;
+            case 6:
+                deinterleaveFixed<6>(src, dst, 0, frames);
+                break;
+            case 8:
+                deinterleave8(src, dst, frames);
+                break;
+            default:
+                for (size_t i = 0; i < frames; ++i) {
+                    for (uint32_t c = 0; c < channelNum; ++c) {
+                        dst[c][i] = src[i * channelNum + c];
+                    }
+                }
+        }
+    }
+
+    const char *getIsaName() {
+        return kernels().name;
+    }
+}
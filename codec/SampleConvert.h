@@ -0,0 +1,66 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Vectorized conversions between the sample formats. The implementation is chosen once at runtime depending on the
+ * instruction sets the cpu supports. Float samples are normalized to [-1, 1], conversions to pcm16 saturate.
+ */
+namespace sampleconv {
+    // Linear gains of one source channel on the left and right output channel
+    struct StereoGain {
+        float left;
+        float right;
+    };
+
+    /**
+     * Constant power panning, the sum of the squared gains stays gain^2 over the whole range.
+     * @param gain Linear gain
+     * @param pan -1 is left, 0 is center and 1 is right
+     */
+    StereoGain getPanGain(float gain, float pan);
+
+    // dst = src << 8
+    void s8ToS16(const int8_t *src, int16_t *dst, size_t count);
+
+    // dst = src << 16
+    void s16ToS32(const int16_t *src, int32_t *dst, size_t count);
+
+    // dst = src >> 16
+    void s32ToS16(const int32_t *src, int16_t *dst, size_t count);
+
+    // dst = src / 32768 * gain
+    void s16ToF32(const int16_t *src, float *dst, size_t count, float gain = 1.0f);
+
+    // dst = saturate(round(src * 32768 * gain))
+    void f32ToS16(const float *src, int16_t *dst, size_t count, float gain = 1.0f);
+
+    // Swaps the byte order of every sample, src and dst may be the same buffer
+    void bswapS16(const int16_t *src, int16_t *dst, size_t count);
+
+    /**
+     * left += src / 32768 * gain.left and right += src / 32768 * gain.right. The gain ramps linearly from from (at the
+     * first sample) to to (reached after the last sample), so gain changes don't click.
+     */
+    void mixS16(const int16_t *src, float *left, float *right, size_t count, StereoGain from, StereoGain to);
+
+    /**
+     * Interleaves one buffer per channel into frames. 1, 2, 4, 6 and 8 channels have specialized kernels.
+     */
+    void interleaveS16(const int16_t *const *src, int16_t *dst, uint32_t channelNum, size_t frames);
+
+    /**
+     * Splits interleaved frames into one buffer per channel. 1, 2, 4, 6 and 8 channels have specialized kernels.
+     */
+    void deinterleaveS16(const int16_t *src, int16_t *const *dst, uint32_t channelNum, size_t frames);
+
+    /**
+     * @return The name of the instruction set the conversions use
+     */
+    const char *getIsaName();
+}
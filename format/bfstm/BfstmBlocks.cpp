@@ -0,0 +1,47 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <algorithm>
+#include "BfstmBlocks.h"
+#include "../../codec/DspADPCM.h"
+
+static uint32_t getBytesForSamples(SoundEncoding encoding, uint32_t sampleCount) {
+    switch (encoding) {
+        case SoundEncoding::PCM8:
+            return sampleCount;
+        case SoundEncoding::PCM16:
+            return sampleCount * 2;
+        case SoundEncoding::DSP_ADPCM:
+            return dspadpcm::getBytesForSamples(sampleCount);
+        case SoundEncoding::IMA_ADPCM:
+            return (sampleCount + 1) / 2;
+        default:
+            return 0;
+    }
+}
+
+BfstmBlockRange::BfstmBlockRange(const BfstmContext &context, const void *dataPtr)
+        : m_StreamInfo(context.streamInfo), m_Data(static_cast<const uint8_t *>(dataPtr)),
+          m_History(context.seekTable.empty() ? nullptr : context.seekTable.data()) {
+    // A channel never spans more than its stride, even if the header sizes disagree with the sample counts
+    m_BlockBytes = std::min(m_StreamInfo.blockSizeBytes,
+                            getBytesForSamples(m_StreamInfo.soundEncoding, m_StreamInfo.blockSizeSamples));
+    m_LastBlockBytes = std::min(m_StreamInfo.lastBlockSizeBytesRaw,
+                                getBytesForSamples(m_StreamInfo.soundEncoding, m_StreamInfo.lastBlockSizeSamples));
+}
+
+BfstmBlock BfstmBlockRange::operator[](uint32_t block) const {
+    bool isLast = block + 1 == m_StreamInfo.blockCountPerChannel;
+    return {
+            .index = block,
+            .startSample = block * m_StreamInfo.blockSizeSamples,
+            .sampleCount = isLast ? m_StreamInfo.lastBlockSizeSamples : m_StreamInfo.blockSizeSamples,
+            .channelStride = isLast ? m_StreamInfo.lastBlockSizeBytesRaw : m_StreamInfo.blockSizeBytes,
+            .sizeBytes = isLast ? m_LastBlockBytes : m_BlockBytes,
+            .channelNum = m_StreamInfo.channelNum,
+            .isLast = isLast,
+            .data = m_Data + block * m_StreamInfo.channelNum * m_StreamInfo.blockSizeBytes,
+            .history = m_History ? m_History + block * m_StreamInfo.channelNum : nullptr,
+    };
+}
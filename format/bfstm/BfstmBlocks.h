@@ -0,0 +1,107 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include "BfstmFile.h"
+
+/**
+ * One block of a stream. Only points into the sample data, nothing is copied.
+ */
+struct BfstmBlock {
+    uint32_t index;
+    uint32_t startSample;
+    uint32_t sampleCount;
+    // Bytes between the channels of this block, the last block is padded to lastBlockSizeBytesRaw
+    uint32_t channelStride;
+    // Bytes of one channel without padding
+    uint32_t sizeBytes;
+    uint8_t channelNum;
+    bool isLast;
+    const uint8_t *data;
+    // History before the block from the seek table, one entry per channel. nullptr without seek table.
+    const BfstmHistoryInfo *history;
+
+    [[nodiscard]] const uint8_t *getChannelPtr(uint32_t channel) const {
+        return data + channel * channelStride;
+    }
+
+    [[nodiscard]] std::span<const uint8_t> getChannel(uint32_t channel) const {
+        return {getChannelPtr(channel), sizeBytes};
+    }
+};
+
+/**
+ * Walks the blocks of a stream. Block i starts at i * channelNum * blockSizeBytes, the channels of the last block
+ * are lastBlockSizeBytesRaw apart.
+ */
+class BfstmBlockRange {
+public:
+    class Iterator {
+    public:
+        using iterator_concept = std::forward_iterator_tag;
+        using iterator_category = std::input_iterator_tag;
+        using value_type = BfstmBlock;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator() = default;
+
+        Iterator(const BfstmBlockRange *range, uint32_t index) : m_Range(range), m_Index(index) {}
+
+        BfstmBlock operator*() const {
+            return (*m_Range)[m_Index];
+        }
+
+        Iterator &operator++() {
+            ++m_Index;
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++m_Index;
+            return old;
+        }
+
+        bool operator==(const Iterator &other) const {
+            return m_Index == other.m_Index;
+        }
+
+    private:
+        const BfstmBlockRange *m_Range = nullptr;
+        uint32_t m_Index = 0;
+    };
+
+    /**
+     * @param dataPtr Pointer to the sample data (same as for AudioPlayback::play)
+     */
+    BfstmBlockRange(const BfstmContext &context, const void *dataPtr);
+
+    /**
+     * No oob check!
+     */
+    BfstmBlock operator[](uint32_t block) const;
+
+    [[nodiscard]] uint32_t size() const {
+        return m_StreamInfo.blockCountPerChannel;
+    }
+
+    [[nodiscard]] Iterator begin() const {
+        return {this, 0};
+    }
+
+    [[nodiscard]] Iterator end() const {
+        return {this, size()};
+    }
+
+private:
+    const BfstmStreamInfo &m_StreamInfo;
+    const uint8_t *m_Data;
+    const BfstmHistoryInfo *m_History;
+    uint32_t m_BlockBytes;
+    uint32_t m_LastBlockBytes;
+};
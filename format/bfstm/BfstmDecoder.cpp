@@ -0,0 +1,216 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "BfstmBlocks.h"
+#include "BfstmDecoder.h"
+#include "BfstmFile.h"
+#include "BfstmSeekIndex.h"
+#include "../../ThreadPool.h"
+#include "../../codec/DspADPCM.h"
+#include "../../codec/ImaADPCM.h"
+#include "../../codec/SampleConvert.h"
+
+uint32_t getStreamSampleCount(const BfstmStreamInfo &streamInfo) {
+    if (streamInfo.blockCountPerChannel == 0) return 0;
+    return (streamInfo.blockCountPerChannel - 1) * streamInfo.blockSizeSamples + streamInfo.lastBlockSizeSamples;
+}
+
+// dst points to the sample from of the block, for dsp-adpcm yn1 and yn2 hold the history of the frame that contains it
+static void decodeBlock(const BfstmContext &context, const BfstmBlock &block, uint32_t channel, uint32_t from,
+                        int16_t &yn1, int16_t &yn2, int16_t *dst) {
+    // For ima-adpcm yn1 is the predictor and yn2 the step index, they belong to the block start
+    uint32_t frameCount = block.sampleCount - from;
+    const uint8_t *src = block.getChannelPtr(channel);
+
+    switch (context.streamInfo.soundEncoding) {
+        case SoundEncoding::DSP_ADPCM:
+            dspadpcm::decode(src, dst, yn1, yn2, get<BfstmDSPADPCMChannelInfo>(context.channelInfos[channel]).coefficients,
+                             frameCount, from);
+            break;
+        case SoundEncoding::IMA_ADPCM: {
+            auto stepIndex = static_cast<uint8_t>(yn2);
+            imaadpcm::decode(src, dst, yn1, stepIndex, frameCount, from);
+            yn2 = stepIndex;
+            break;
+        }
+        case SoundEncoding::PCM16:
+            if (context.header.isByteOrderSwapped()) {
+                sampleconv::bswapS16(reinterpret_cast<const int16_t *>(src) + from, dst, frameCount);
+            } else {
+                std::memcpy(dst, reinterpret_cast<const int16_t *>(src) + from, frameCount * sizeof(int16_t));
+            }
+            break;
+        case SoundEncoding::PCM8:
+            sampleconv::s8ToS16(reinterpret_cast<const int8_t *>(src) + from, dst, frameCount);
+            break;
+        default:
+            break;
+    }
+}
+
+bool decodeBfstm(const BfstmContext &context, const void *dataPtr, int16_t *dst,
+                 ThreadPool &pool, uint32_t startSample, BfstmSeekIndex *index) {
+    const auto &streamInfo = context.streamInfo;
+    if (streamInfo.soundEncoding > SoundEncoding::IMA_ADPCM) {
+        std::cerr << "Cannot decode unknown encoding " << static_cast<int>(streamInfo.soundEncoding) << std::endl;
+        return false;
+    }
+    BfstmBlockRange blocks{context, dataPtr};
+    uint32_t sampleCount = getStreamSampleCount(streamInfo);
+    uint32_t channelNum = streamInfo.channelNum;
+    if (startSample != 0 && startSample >= sampleCount) {
+        std::cerr << "Start sample " << startSample << " is after the stream end!" << std::endl;
+        return false;
+    }
+    uint32_t outCount = sampleCount - startSample;
+    uint32_t firstBlock = startSample == 0 ? 0 : startSample / streamInfo.blockSizeSamples;
+    auto getFrom = [&](const BfstmBlock &block) {
+        return block.index == firstBlock ? startSample - block.startSample : 0;
+    };
+    auto getDst = [&](const BfstmBlock &block, uint32_t ch, uint32_t from) {
+        return dst + static_cast<size_t>(ch) * outCount + block.startSample + from - startSample;
+    };
+
+    // The dsp-adpcm history of the frame that contains the start sample
+    std::shared_ptr<int16_t[][2]> startYn;
+    if (startSample != 0 && streamInfo.soundEncoding == SoundEncoding::DSP_ADPCM) {
+        startYn = std::make_unique_for_overwrite<int16_t[][2]>(channelNum);
+        if (!index || !index->getDspYn(startSample, startYn)) {
+            std::cerr << "Dsp-adpcm streams need a seek index to start at sample " << startSample << std::endl;
+            return false;
+        }
+    }
+
+    if (streamInfo.soundEncoding == SoundEncoding::IMA_ADPCM ||
+        (streamInfo.soundEncoding == SoundEncoding::DSP_ADPCM && context.seekTable.empty())) {
+        // Every block depends on the previous one, so only the channels are independent
+        pool.parallelFor(channelNum, [&](uint32_t ch) {
+            int16_t yn1, yn2;
+            if (streamInfo.soundEncoding == SoundEncoding::IMA_ADPCM) {
+                const auto &ima = get<BfstmIMAADPCMChannelInfo>(context.channelInfos[ch]);
+                yn1 = ima.startContext.predictor;
+                yn2 = ima.startContext.stepIndex;
+            } else if (startYn) {
+                yn1 = startYn[ch][0];
+                yn2 = startYn[ch][1];
+            } else {
+                const auto &dsp = get<BfstmDSPADPCMChannelInfo>(context.channelInfos[ch]);
+                yn1 = dsp.startContext.yn1;
+                yn2 = dsp.startContext.yn2;
+            }
+            for (const BfstmBlock block: blocks) {
+                if (block.index < firstBlock) {
+                    // Ima-adpcm has no history to start from, the skipped samples only advance the state
+                    if (streamInfo.soundEncoding == SoundEncoding::IMA_ADPCM) {
+                        auto stepIndex = static_cast<uint8_t>(yn2);
+                        imaadpcm::decode(block.getChannelPtr(ch), nullptr, yn1, stepIndex, 0, block.sampleCount);
+                        yn2 = stepIndex;
+                    }
+                    continue;
+                }
+                uint32_t from = getFrom(block);
+                decodeBlock(context, block, ch, from, yn1, yn2, getDst(block, ch, from));
+            }
+        });
+        return true;
+    }
+
+    uint32_t blockCount = blocks.size() - firstBlock;
+    pool.parallelFor(blockCount * channelNum, [&](uint32_t task) {
+        BfstmBlock block = blocks[firstBlock + task / channelNum];
+        uint32_t ch = task % channelNum;
+        int16_t yn1 = 0;
+        int16_t yn2 = 0;
+        if (startYn && block.index == firstBlock) {
+            yn1 = startYn[ch][0];
+            yn2 = startYn[ch][1];
+        } else if (block.history) {
+            yn1 = block.history[ch].histSample1;
+            yn2 = block.history[ch].histSample2;
+        }
+        uint32_t from = getFrom(block);
+        decodeBlock(context, block, ch, from, yn1, yn2, getDst(block, ch, from));
+    });
+    return true;
+}
+
+// mix points to the first frame of the block, scratch is only used for encodings other than dsp-adpcm
+static void mixBlock(const BfstmContext &context, const BfstmBlock &block, uint32_t channel,
+                     int16_t &yn1, int16_t &yn2, float *mix, sampleconv::StereoGain gain,
+                     std::vector<int16_t> &scratch) {
+    uint32_t frameCount = block.sampleCount;
+
+    if (context.streamInfo.soundEncoding == SoundEncoding::DSP_ADPCM) {
+        dspadpcm::decodeMix(block.getChannelPtr(channel), mix, yn1, yn2, get<BfstmDSPADPCMChannelInfo>(context.channelInfos[channel]).coefficients,
+                            frameCount, 0, gain);
+        return;
+    }
+
+    scratch.resize(frameCount);
+    decodeBlock(context, block, channel, 0, yn1, yn2, scratch.data());
+    const float left = gain.left / 32768.0f;
+    const float right = gain.right / 32768.0f;
+    for (uint32_t i = 0; i < frameCount; ++i) {
+        mix[i * 2] += static_cast<float>(scratch[i]) * left;
+        mix[i * 2 + 1] += static_cast<float>(scratch[i]) * right;
+    }
+}
+
+bool decodeBfstmMix(const BfstmContext &context, const void *dataPtr, float *mix,
+                    std::span<const sampleconv::StereoGain> gains, ThreadPool &pool) {
+    const auto &streamInfo = context.streamInfo;
+    if (streamInfo.soundEncoding > SoundEncoding::IMA_ADPCM) {
+        std::cerr << "Cannot decode unknown encoding " << static_cast<int>(streamInfo.soundEncoding) << std::endl;
+        return false;
+    }
+    if (gains.size() != streamInfo.channelNum) {
+        std::cerr << "Expected " << static_cast<int>(streamInfo.channelNum) << " channel gains, got " << gains.size()
+                  << std::endl;
+        return false;
+    }
+    BfstmBlockRange blocks{context, dataPtr};
+    uint32_t channelNum = streamInfo.channelNum;
+
+    if (streamInfo.soundEncoding == SoundEncoding::IMA_ADPCM ||
+        (streamInfo.soundEncoding == SoundEncoding::DSP_ADPCM && context.seekTable.empty())) {
+        // Every block depends on the previous one and all channels share the mix, so this runs serially
+        std::vector<int16_t> scratch;
+        for (uint32_t ch = 0; ch < channelNum; ++ch) {
+            int16_t yn1, yn2;
+            if (streamInfo.soundEncoding == SoundEncoding::IMA_ADPCM) {
+                const auto &ima = get<BfstmIMAADPCMChannelInfo>(context.channelInfos[ch]);
+                yn1 = ima.startContext.predictor;
+                yn2 = ima.startContext.stepIndex;
+            } else {
+                const auto &dsp = get<BfstmDSPADPCMChannelInfo>(context.channelInfos[ch]);
+                yn1 = dsp.startContext.yn1;
+                yn2 = dsp.startContext.yn2;
+            }
+            for (const BfstmBlock block: blocks) {
+                mixBlock(context, block, ch, yn1, yn2, mix + block.startSample * 2, gains[ch], scratch);
+            }
+        }
+        return true;
+    }
+
+    // A block covers its own range of the mix, so blocks are independent tasks that mix all of their channels
+    pool.parallelFor(blocks.size(), [&](uint32_t index) {
+        BfstmBlock block = blocks[index];
+        std::vector<int16_t> scratch;
+        for (uint32_t ch = 0; ch < channelNum; ++ch) {
+            int16_t yn1 = 0;
+            int16_t yn2 = 0;
+            if (block.history) {
+                yn1 = block.history[ch].histSample1;
+                yn2 = block.history[ch].histSample2;
+            }
+            mixBlock(context, block, ch, yn1, yn2, mix + block.startSample * 2, gains[ch], scratch);
+        }
+    });
+    return true;
+}
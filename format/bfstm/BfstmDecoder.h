@@ -0,0 +1,45 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include "../../codec/SampleConvert.h"
+
+struct BfstmContext;
+struct BfstmStreamInfo;
+class BfstmSeekIndex;
+class ThreadPool;
+
+/**
+ * @return The number of samples per channel of the stream
+ */
+uint32_t getStreamSampleCount(const BfstmStreamInfo &streamInfo);
+
+/**
+ * Decodes the whole stream to pcm16. Every (block, channel) pair is an independent task on the pool, dsp-adpcm blocks
+ * start from the history in the seek table. Without seek table (and always for ima-adpcm) the blocks of one
+ * channel are decoded serially.
+ * @param context The stream context
+ * @param dataPtr Pointer to the sample data (same as for AudioPlayback::play)
+ * @param dst Preallocated planar buffer with getStreamSampleCount() - startSample samples per channel, channel after
+ * channel
+ * @param startSample The first decoded sample. Dsp-adpcm streams get the history there from the index, ima-adpcm
+ * streams decode the samples before it without output.
+ * @param index Only needed for dsp-adpcm streams and a start sample other than 0
+ * @return false if the encoding is not supported or the start sample cannot be reached
+ */
+bool decodeBfstm(const BfstmContext &context, const void *dataPtr, int16_t *dst,
+                 ThreadPool &pool, uint32_t startSample = 0, BfstmSeekIndex *index = nullptr);
+
+/**
+ * Decodes all channels and adds them to an interleaved stereo float mix. Dsp-adpcm samples go straight into the mix
+ * without a pcm16 buffer in between. With seek table the blocks are mixed in parallel.
+ * @param mix Interleaved stereo buffer with getStreamSampleCount() frames, the stream is added to its content
+ * @param gains One gain per channel, see sampleconv::getPanGain
+ * @return false if the encoding is not supported or the gain count does not match
+ */
+bool decodeBfstmMix(const BfstmContext &context, const void *dataPtr, float *mix,
+                    std::span<const sampleconv::StereoGain> gains, ThreadPool &pool);
@@ -0,0 +1,308 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "BfstmEdit.h"
+#include "BfstmBlocks.h"
+#include "BfstmDecoder.h"
+#include "BfstmWriter.h"
+#include "../../MemoryResource.h"
+#include "../../ThreadPool.h"
+#include "../../codec/DspADPCM.h"
+#include "../../codec/ImaADPCM.h"
+#include "../../codec/SampleConvert.h"
+
+static uint32_t getBytesForSamples(SoundEncoding encoding, uint32_t sampleCount) {
+    switch (encoding) {
+        case SoundEncoding::PCM8:
+            return sampleCount;
+        case SoundEncoding::PCM16:
+            return sampleCount * 2;
+        case SoundEncoding::DSP_ADPCM:
+            return dspadpcm::getBytesForSamples(sampleCount);
+        case SoundEncoding::IMA_ADPCM:
+            return (sampleCount + 1) / 2;
+        default:
+            return 0;
+    }
+}
+
+static BfstmWriteInfo getWriteInfo(const BfstmContext &context, uint32_t blockSizeBytes) {
+    const BfstmStreamInfo &streamInfo = context.streamInfo;
+    return {
+            .encoding = streamInfo.soundEncoding,
+            .channelNum = streamInfo.channelNum,
+            .isLoop = streamInfo.isLoop != 0,
+            .sampleRate = streamInfo.sampleRate,
+            .loopStart = streamInfo.loopStart,
+            .loopEnd = streamInfo.loopEnd,
+            .sampleCount = getStreamSampleCount(streamInfo),
+            .blockSizeBytes = blockSizeBytes,
+            .channelInfos = context.channelInfos,
+            .regionInfos = context.regionInfos,
+            .trackInfos = context.trackInfos,
+    };
+}
+
+// The history before every old block, decoded once from the stream start
+static std::vector<BfstmHistoryInfo> buildSeekTable(const BfstmContext &context, const BfstmBlockRange &blocks,
+                                                    ThreadPool &pool) {
+    const uint32_t channelNum = context.streamInfo.channelNum;
+    std::vector<BfstmHistoryInfo> seekTable(blocks.size() * channelNum);
+    pool.parallelFor(channelNum, [&](uint32_t ch) {
+        const auto &dsp = get<BfstmDSPADPCMChannelInfo>(context.channelInfos[ch]);
+        int16_t yn1 = dsp.startContext.yn1, yn2 = dsp.startContext.yn2;
+        std::vector<int16_t> samples(context.streamInfo.blockSizeSamples);
+        for (BfstmBlock block: blocks) {
+            seekTable[block.index * channelNum + ch] = {yn1, yn2};
+            dspadpcm::decode(block.getChannelPtr(ch), samples.data(), yn1, yn2, dsp.coefficients,
+                             block.sampleCount, 0);
+        }
+    });
+    return seekTable;
+}
+
+bool reblockBfstm(std::ostream &out, const BfstmContext &context, const void *dataPtr, uint32_t blockSizeBytes,
+                  ThreadPool &pool) {
+    const BfstmStreamInfo &streamInfo = context.streamInfo;
+    const SoundEncoding encoding = streamInfo.soundEncoding;
+    const bool isDsp = encoding == SoundEncoding::DSP_ADPCM;
+    const uint32_t channelNum = streamInfo.channelNum;
+    if (streamInfo.blockCountPerChannel == 0 || streamInfo.blockSizeSamples == 0) {
+        std::cerr << "Stream has no blocks!" << std::endl;
+        return false;
+    }
+    if (isDsp && context.channelInfos.size() != channelNum) {
+        std::cerr << "Dsp-adpcm stream without channel infos!" << std::endl;
+        return false;
+    }
+
+    BfstmWriter writer{out, getWriteInfo(context, blockSizeBytes)};
+    if (!writer.success) return false;
+    const uint32_t newSamples = writer.getBlockSizeSamples();
+    const uint32_t oldSamples = streamInfo.blockSizeSamples;
+    const uint32_t sampleCount = getStreamSampleCount(streamInfo);
+    const uint32_t newBlockCount = (sampleCount + newSamples - 1) / newSamples;
+    if (streamInfo.isLoop && streamInfo.loopStart % newSamples != 0) {
+        std::cout << "Warning: Loop start " << streamInfo.loopStart << " is not aligned to the new block size of "
+                  << newSamples << " samples." << std::endl;
+    }
+
+    BfstmBlockRange blocks{context, dataPtr};
+    std::vector<BfstmHistoryInfo> history;
+    if (isDsp) {
+        // The old seek table holds the history at every old block start, only the samples from there to the new
+        // block start have to be decoded. If the new size is a multiple of the old one nothing is decoded.
+        std::vector<BfstmHistoryInfo> rebuilt;
+        const BfstmHistoryInfo *seekTable = context.seekTable.data();
+        if (context.seekTable.size() != streamInfo.blockCountPerChannel * channelNum) {
+            rebuilt = buildSeekTable(context, blocks, pool);
+            seekTable = rebuilt.data();
+        }
+        history.resize(newBlockCount * channelNum);
+        // Every old block decodes up to the last new block start inside it, nothing after that
+        pool.parallelFor(blocks.size() * channelNum, [&](uint32_t task) {
+            uint32_t oldBlock = task / channelNum, ch = task % channelNum;
+            uint32_t oldStart = oldBlock * oldSamples;
+            uint32_t block = (oldStart + newSamples - 1) / newSamples;
+            BfstmHistoryInfo hist = seekTable[task];
+            const auto &dsp = get<BfstmDSPADPCMChannelInfo>(context.channelInfos[ch]);
+            const uint8_t *src = blocks[oldBlock].getChannelPtr(ch);
+            std::vector<int16_t> samples;
+            uint32_t decoded = 0;
+            for (; block < newBlockCount && block * newSamples < oldStart + oldSamples; ++block) {
+                uint32_t offset = block * newSamples - oldStart;
+                if (offset > decoded) {
+                    samples.resize(offset - decoded);
+                    dspadpcm::decode(src, samples.data(), hist.histSample1, hist.histSample2, dsp.coefficients,
+                                     offset - decoded, decoded);
+                    decoded = offset;
+                }
+                history[block * channelNum + ch] = hist;
+            }
+        });
+    }
+
+    // Old blocks always start at a frame, so every new block is a run of whole frames of one or more old blocks
+    const bool swap = encoding == SoundEncoding::PCM16 && context.header.isByteOrderSwapped();
+    std::vector<std::vector<uint8_t>> buffers(channelNum);
+    std::vector<const uint8_t *> channels(channelNum);
+    for (uint32_t block = 0; block < newBlockCount; ++block) {
+        uint32_t start = block * newSamples;
+        uint32_t count = std::min(newSamples, sampleCount - start);
+        uint32_t firstOld = start / oldSamples, lastOld = (start + count - 1) / oldSamples;
+        for (uint32_t ch = 0; ch < channelNum; ++ch) {
+            if (firstOld == lastOld && !swap) {
+                uint32_t offset = start - firstOld * oldSamples;
+                channels[ch] = blocks[firstOld].getChannelPtr(ch) + getBytesForSamples(encoding, offset);
+                continue;
+            }
+            auto &buffer = buffers[ch];
+            buffer.resize(getBytesForSamples(encoding, count));
+            uint32_t written = 0;
+            for (uint32_t old = firstOld; old <= lastOld; ++old) {
+                uint32_t oldStart = old * oldSamples;
+                uint32_t from = std::max(start, oldStart) - oldStart;
+                uint32_t to = std::min(start + count, oldStart + oldSamples) - oldStart;
+                uint32_t fromBytes = getBytesForSamples(encoding, from);
+                uint32_t bytes = getBytesForSamples(encoding, to) - fromBytes;
+                std::memcpy(buffer.data() + written, blocks[old].getChannelPtr(ch) + fromBytes, bytes);
+                written += bytes;
+            }
+            if (swap) {
+                auto *samples = reinterpret_cast<int16_t *>(buffer.data());
+                sampleconv::bswapS16(samples, samples, written / 2);
+            }
+            channels[ch] = buffer.data();
+        }
+        if (!writer.writeEncodedBlock(channels.data(), count, isDsp ? history.data() + block * channelNum : nullptr)) {
+            return false;
+        }
+    }
+    return writer.finish();
+}
+
+// Offsets of the loop fields in the stream info
+static constexpr uint32_t loopOffset = 0x1, loopStartOffset = 0x8, loopStartUnalignedOffset = 0x44;
+// Offsets of the loop contexts in the adpcm infos
+static constexpr uint32_t dspLoopContextOffset = 0x26, imaLoopContextOffset = 0x4;
+
+static DSPAdpcmContext getDspContextAt(const BfstmContext &context, const BfstmBlockRange &blocks, uint32_t channel,
+                                       uint32_t sample) {
+    const uint32_t channelNum = context.streamInfo.channelNum;
+    const auto &dsp = get<BfstmDSPADPCMChannelInfo>(context.channelInfos[channel]);
+    const uint32_t blockIndex = sample / context.streamInfo.blockSizeSamples;
+    std::vector<int16_t> samples(context.streamInfo.blockSizeSamples);
+    int16_t yn1 = dsp.startContext.yn1, yn2 = dsp.startContext.yn2;
+    if (context.seekTable.size() == blocks.size() * channelNum) {
+        yn1 = context.seekTable[blockIndex * channelNum + channel].histSample1;
+        yn2 = context.seekTable[blockIndex * channelNum + channel].histSample2;
+    } else {
+        for (uint32_t i = 0; i < blockIndex; ++i) {
+            BfstmBlock block = blocks[i];
+            dspadpcm::decode(block.getChannelPtr(channel), samples.data(), yn1, yn2, dsp.coefficients,
+                             block.sampleCount, 0);
+        }
+    }
+    BfstmBlock block = blocks[blockIndex];
+    uint32_t offset = sample - block.startSample;
+    dspadpcm::decode(block.getChannelPtr(channel), samples.data(), yn1, yn2, dsp.coefficients, offset, 0);
+    // The header of the frame that contains the sample
+    return {block.getChannelPtr(channel)[offset / 14 * 8], yn1, yn2};
+}
+
+static IMAAdpcmContext getImaContextAt(const BfstmContext &context, const BfstmBlockRange &blocks, uint32_t channel,
+                                       uint32_t sample) {
+    IMAAdpcmContext ima = get<BfstmIMAADPCMChannelInfo>(context.channelInfos[channel]).startContext;
+    std::vector<int16_t> samples(context.streamInfo.blockSizeSamples);
+    for (BfstmBlock block: blocks) {
+        uint32_t count = std::min(block.sampleCount, sample - block.startSample);
+        imaadpcm::decode(block.getChannelPtr(channel), samples.data(), ima.predictor, ima.stepIndex, count, 0);
+        if (block.startSample + count >= sample) break;
+    }
+    return ima;
+}
+
+bool setBfstmLoop(BfstmContext &context, const void *dataPtr, const BfstmLoopEdit &loop, ThreadPool &pool) {
+    BfstmStreamInfo &streamInfo = context.streamInfo;
+    const uint32_t sampleCount = getStreamSampleCount(streamInfo);
+    if (loop.isLoop && (loop.loopStart >= loop.loopEnd || loop.loopEnd > sampleCount)) {
+        std::cerr << "Loop " << loop.loopStart << " - " << loop.loopEnd << " is invalid!" << std::endl;
+        return false;
+    }
+    const uint32_t loopStart = !loop.isLoop ? 0 :
+                               loop.alignToBlock ? loop.loopStart / streamInfo.blockSizeSamples *
+                                                   streamInfo.blockSizeSamples : loop.loopStart;
+    const uint32_t loopEnd = loop.isLoop ? loop.loopEnd : sampleCount;
+    if (loop.isLoop && loopStart % streamInfo.blockSizeSamples != 0) {
+        std::cout << "Warning: Loop start " << loopStart << " is not aligned to the block size of "
+                  << streamInfo.blockSizeSamples << " samples." << std::endl;
+    }
+
+    const SoundEncoding encoding = streamInfo.soundEncoding;
+    if (loop.isLoop && (encoding == SoundEncoding::DSP_ADPCM || encoding == SoundEncoding::IMA_ADPCM)) {
+        if (context.channelInfos.size() != streamInfo.channelNum) {
+            std::cerr << "Adpcm stream without channel infos!" << std::endl;
+            return false;
+        }
+        BfstmBlockRange blocks{context, dataPtr};
+        pool.parallelFor(streamInfo.channelNum, [&](uint32_t ch) {
+            if (encoding == SoundEncoding::DSP_ADPCM) {
+                get<BfstmDSPADPCMChannelInfo>(context.channelInfos[ch]).loopContext =
+                        getDspContextAt(context, blocks, ch, loopStart);
+            } else {
+                get<BfstmIMAADPCMChannelInfo>(context.channelInfos[ch]).loopContext =
+                        getImaContextAt(context, blocks, ch, loopStart);
+            }
+        });
+    }
+    streamInfo.isLoop = loop.isLoop;
+    streamInfo.loopStart = loopStart;
+    streamInfo.loopEnd = loopEnd;
+    streamInfo.loopStartUnaligned = loop.isLoop ? loop.loopStart : 0;
+    streamInfo.loopEndUnaligned = loopEnd;
+    return true;
+}
+
+bool patchBfstmLoop(std::ostream &file, const BfstmContext &context) {
+    const BfstmStreamInfo &streamInfo = context.streamInfo;
+    if (!context.header.infoSection || !context.info.streamInfo) {
+        std::cerr << "Stream has no stream info!" << std::endl;
+        return false;
+    }
+    const SoundEncoding encoding = streamInfo.soundEncoding;
+    const bool isAdpcm = encoding == SoundEncoding::DSP_ADPCM || encoding == SoundEncoding::IMA_ADPCM;
+    if (isAdpcm && context.channelInfoOffsets.size() != context.channelInfos.size()) {
+        std::cerr << "Channel info positions are unknown!" << std::endl;
+        return false;
+    }
+    // Every field is written into its own small buffer in the byte order of the file
+    auto patch = [&file, &context](uint32_t offset, auto &&write) {
+        MemoryResource resource{};
+        OutMemoryStream stream{resource};
+        stream.swapBO = context.header.isByteOrderSwapped();
+        write(stream);
+        file.seekp(offset);
+        file.write(static_cast<const char *>(resource.getAsPtrUnsafe(0)), static_cast<std::streamsize>(stream.tell()));
+    };
+
+    const uint32_t streamInfoOffset = context.header.infoSection->offset + 0x8 + context.info.streamInfo->offset;
+    patch(streamInfoOffset + loopOffset, [&](OutMemoryStream &stream) {
+        stream.writeU8(streamInfo.isLoop);
+    });
+    patch(streamInfoOffset + loopStartOffset, [&](OutMemoryStream &stream) {
+        stream.writeU32(streamInfo.loopStart);
+        stream.writeU32(streamInfo.loopEnd);
+    });
+    if (context.header.version > 0x40000) {
+        patch(streamInfoOffset + loopStartUnalignedOffset, [&](OutMemoryStream &stream) {
+            stream.writeU32(streamInfo.loopStartUnaligned);
+            stream.writeU32(streamInfo.loopEndUnaligned);
+        });
+    }
+    for (size_t ch = 0; isAdpcm && ch < context.channelInfos.size(); ++ch) {
+        if (encoding == SoundEncoding::DSP_ADPCM) {
+            const auto &loopContext = get<BfstmDSPADPCMChannelInfo>(context.channelInfos[ch]).loopContext;
+            patch(context.channelInfoOffsets[ch] + dspLoopContextOffset, [&](OutMemoryStream &stream) {
+                stream.writeU16(loopContext.header);
+                stream.writeS16(loopContext.yn1);
+                stream.writeS16(loopContext.yn2);
+            });
+        } else {
+            const auto &loopContext = get<BfstmIMAADPCMChannelInfo>(context.channelInfos[ch]).loopContext;
+            patch(context.channelInfoOffsets[ch] + imaLoopContextOffset, [&](OutMemoryStream &stream) {
+                stream.writeS16(loopContext.predictor);
+                stream.writeU8(loopContext.stepIndex);
+            });
+        }
+    }
+    file.flush();
+    if (!file) {
+        std::cerr << "Cannot patch the loop!" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include "BfstmFile.h"
+
+class ThreadPool;
+
+/**
+ * Writes the stream with a new block size without re-encoding. The sample data is copied frame by frame into the new
+ * blocks, dsp-adpcm only decodes from the closest old seek entry to the start of every new block to get the history
+ * for the new seek table. Streams without seek table are decoded once to rebuild it.
+ * @param dataPtr Pointer to the sample data (same as for AudioPlayback::play)
+ * @param blockSizeBytes Multiple of 0x20
+ * @return false if the stream cannot be written with this block size
+ */
+bool reblockBfstm(std::ostream &out, const BfstmContext &context, const void *dataPtr, uint32_t blockSizeBytes,
+                  ThreadPool &pool);
+
+struct BfstmLoopEdit {
+    bool isLoop;
+    uint32_t loopStart;
+    // Exclusive
+    uint32_t loopEnd;
+    // Moves the loop start down to the start of its block, which playback needs. The requested start is kept as the
+    // unaligned loop start.
+    bool alignToBlock = false;
+};
+
+/**
+ * Moves the loop of the stream without re-encoding. The loop contexts are decoded per channel from the seek entry of
+ * the block with the new loop start, so only the frames of that block before the loop start are decoded. Ima-adpcm
+ * and streams without seek table decode from the stream start.
+ * Updates the stream info and the channel infos of the context, see patchBfstmLoop to write them.
+ * @param dataPtr Pointer to the sample data (same as for AudioPlayback::play)
+ * @return false if the loop is outside of the stream
+ */
+bool setBfstmLoop(BfstmContext &context, const void *dataPtr, const BfstmLoopEdit &loop, ThreadPool &pool);
+
+/**
+ * Writes the loop of the stream info and the loop contexts of the channel infos to the file the context was read
+ * from, in its byte order. Only these fields are written.
+ * @param file Must be seekable
+ */
+bool patchBfstmLoop(std::ostream &file, const BfstmContext &context);
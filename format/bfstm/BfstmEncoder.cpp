@@ -0,0 +1,252 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <algorithm>
+#include <numeric>
+#include "BfstmEncoder.h"
+#include "../../ThreadPool.h"
+
+static DSPAdpcmContext toContext(const dspadpcm::HistoryCapture &capture) {
+    return {capture.header, capture.yn1, capture.yn2};
+}
+
+// Encodes [from, from + count) of the stream, with the captures inside that range
+static void encodeRange(const int16_t *pcm, uint32_t sampleCount, uint8_t *dst, uint32_t from, uint32_t count,
+                        int16_t &yn1, int16_t &yn2, const int16_t coefs[8][2], dspadpcm::EncodePreset preset,
+                        std::span<dspadpcm::HistoryCapture> captures, EncodeMetrics *metrics) {
+    auto byPosition = [](const dspadpcm::HistoryCapture &capture, uint32_t sample) { return capture.sample < sample; };
+    auto first = std::lower_bound(captures.begin(), captures.end(), from, byPosition);
+    // Positions at or after the end belong to the last range
+    auto last = from + count >= sampleCount ? captures.end()
+                                            : std::lower_bound(first, captures.end(), from + count, byPosition);
+    // A local copy, other ranges may search the shared positions concurrently
+    std::vector<dspadpcm::HistoryCapture> inRange{first, last};
+    for (auto &capture: inRange) capture.sample -= from;
+    dspadpcm::encode(pcm + from, dst + from / 14 * 8, yn1, yn2, coefs, count, preset, inRange, metrics);
+    for (size_t i = 0; i < inRange.size(); ++i) {
+        first[i].header = inRange[i].header;
+        first[i].yn1 = inRange[i].yn1;
+        first[i].yn2 = inRange[i].yn2;
+    }
+}
+
+// Frames at the start of a block whose metrics are kept apart, reconciliation usually ends within them
+static constexpr uint32_t headFrames = 8;
+
+BfstmSpeculativeBlock encodeBfstmBlockSpeculative(const int16_t *pcm, uint32_t sampleCount, uint8_t *dst,
+                                                  BfstmHistoryInfo history, const int16_t coefs[8][2],
+                                                  dspadpcm::EncodePreset preset,
+                                                  std::vector<dspadpcm::HistoryCapture> captures) {
+    BfstmSpeculativeBlock spec{.startHistory = history, .endHistory = history, .captures = std::move(captures)};
+    uint32_t headCount = std::min(headFrames * 14, sampleCount);
+    auto &[yn1, yn2] = spec.endHistory;
+    encodeRange(pcm, sampleCount, dst, 0, headCount, yn1, yn2, coefs, preset, spec.captures, &spec.head);
+    if (sampleCount > headCount) {
+        encodeRange(pcm, sampleCount, dst, headCount, sampleCount - headCount, yn1, yn2, coefs, preset,
+                    spec.captures, &spec.tail);
+    }
+    return spec;
+}
+
+void reconcileBfstmBlock(const int16_t *pcm, uint32_t sampleCount, uint8_t *dst, int16_t &yn1, int16_t &yn2,
+                         const int16_t coefs[8][2], dspadpcm::EncodePreset preset, BfstmSpeculativeBlock &block,
+                         EncodeMetrics &metrics) {
+    uint32_t frameCount = (sampleCount + 13) / 14;
+    int16_t specYn1 = block.startHistory.histSample1, specYn2 = block.startHistory.histSample2;
+    std::array<int16_t, 14> specSamples{};
+
+    uint32_t frame = 0;
+    for (; frame < frameCount && (yn1 != specYn1 || yn2 != specYn2); ++frame) {
+        uint32_t frameStart = frame * 14;
+        uint32_t frameSamples = std::min(14u, sampleCount - frameStart);
+        // Follow the speculative history before the frame is overwritten
+        dspadpcm::decode(dst + frame * 8, specSamples.data(), specYn1, specYn2, coefs, frameSamples, 0);
+        encodeRange(pcm, sampleCount, dst, frameStart, frameSamples, yn1, yn2, coefs, preset, block.captures,
+                    &metrics);
+    }
+
+    bool converged = yn1 == specYn1 && yn2 == specYn2;
+
+    // The frames from here on are the speculative ones. Their metrics are known for the whole head and tail, or
+    // are taken from the speculative output if only a part of the head or tail is left.
+    uint32_t headEnd = std::min(headFrames, frameCount);
+    if (frame == 0) {
+        metrics.merge(block.head);
+    }
+    uint32_t decodeEnd = frame == 0 ? 0 : frame <= headEnd ? headEnd : frameCount;
+    for (uint32_t f = frame; f < decodeEnd; ++f) {
+        uint32_t frameStart = f * 14;
+        uint32_t frameSamples = std::min(14u, sampleCount - frameStart);
+        dspadpcm::decode(dst + f * 8, specSamples.data(), specYn1, specYn2, coefs, frameSamples, 0);
+        metrics.accumulate(pcm + frameStart, specSamples.data(), frameSamples);
+    }
+    if (frame <= headEnd) {
+        metrics.merge(block.tail);
+    }
+
+    // Without convergence the whole block was encoded again and yn already is its end history
+    if (converged) {
+        yn1 = block.endHistory.histSample1;
+        yn2 = block.endHistory.histSample2;
+    }
+}
+
+/**
+ * Every block is encoded in parallel, starting from the source samples before it as history. Afterwards the blocks
+ * are reconciled in order, see reconcileBfstmBlock.
+ */
+static void encodeBlocksParallel(const int16_t *pcm, uint32_t sampleCount, uint8_t *dst, uint32_t blockSizeSamples,
+                                 const int16_t coefs[8][2], dspadpcm::EncodePreset preset,
+                                 std::span<dspadpcm::HistoryCapture> captures, EncodeMetrics &metrics,
+                                 ThreadPool &pool) {
+    uint32_t blockCount = (sampleCount + blockSizeSamples - 1) / blockSizeSamples;
+    auto byPosition = [](const dspadpcm::HistoryCapture &capture, uint32_t sample) { return capture.sample < sample; };
+    // The captures of every block, positions at or after the stream end belong to the last one
+    std::vector<size_t> firstCapture(blockCount + 1, captures.size());
+    for (uint32_t block = 0; block < blockCount; ++block) {
+        firstCapture[block] = std::lower_bound(captures.begin(), captures.end(), block * blockSizeSamples,
+                                               byPosition) - captures.begin();
+    }
+    std::vector<BfstmSpeculativeBlock> blocks(blockCount);
+    pool.parallelFor(blockCount, [&](uint32_t block) {
+        uint32_t start = block * blockSizeSamples;
+        uint32_t count = std::min(blockSizeSamples, sampleCount - start);
+        std::vector<dspadpcm::HistoryCapture> local{captures.begin() + firstCapture[block],
+                                                    captures.begin() + firstCapture[block + 1]};
+        for (auto &capture: local) capture.sample -= start;
+        BfstmHistoryInfo history{};
+        if (block != 0) history = {pcm[start - 1], pcm[start - 2]};
+        blocks[block] = encodeBfstmBlockSpeculative(pcm + start, count, dst + start / 14 * 8, history, coefs, preset,
+                                                    std::move(local));
+    });
+
+    int16_t yn1 = 0, yn2 = 0;
+    for (uint32_t block = 0; block < blockCount; ++block) {
+        uint32_t start = block * blockSizeSamples;
+        uint32_t count = std::min(blockSizeSamples, sampleCount - start);
+        reconcileBfstmBlock(pcm + start, count, dst + start / 14 * 8, yn1, yn2, coefs, preset, blocks[block], metrics);
+        for (size_t i = 0; i < blocks[block].captures.size(); ++i) {
+            auto &capture = captures[firstCapture[block] + i];
+            capture.header = blocks[block].captures[i].header;
+            capture.yn1 = blocks[block].captures[i].yn1;
+            capture.yn2 = blocks[block].captures[i].yn2;
+        }
+    }
+}
+
+BfstmChannelEncodeResult encodeBfstmChannel(const int16_t *pcm, uint32_t sampleCount, uint8_t *dst,
+                                            uint32_t blockSizeSamples, std::optional<uint32_t> loopStart,
+                                            std::span<const BfstmRegionInfo> regions,
+                                            dspadpcm::EncodePreset preset, ThreadPool *pool) {
+    BfstmChannelEncodeResult result{};
+    uint32_t blockCount = blockSizeSamples == 0 ? 0 : (sampleCount + blockSizeSamples - 1) / blockSizeSamples;
+
+    // Layout: start, loop, blocks, regions
+    const size_t loopIndex = 1, blockIndex = 2, regionIndex = blockIndex + blockCount;
+    std::vector<dspadpcm::HistoryCapture> captures(regionIndex + regions.size());
+    captures[0].sample = 0;
+    captures[loopIndex].sample = loopStart.value_or(0);
+    for (uint32_t block = 0; block < blockCount; block++) {
+        captures[blockIndex + block].sample = block * blockSizeSamples;
+    }
+    for (size_t region = 0; region < regions.size(); region++) {
+        captures[regionIndex + region].sample = regions[region].startSample;
+    }
+
+    // The encoder needs the positions in order
+    std::vector<size_t> order(captures.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return captures[a].sample < captures[b].sample;
+    });
+    std::vector<dspadpcm::HistoryCapture> sorted(captures.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        sorted[i] = captures[order[i]];
+    }
+
+    auto coefs = dspadpcm::calculateCoefficients(pcm, sampleCount, preset);
+    for (int i = 0; i < 8; i++) {
+        result.channelInfo.coefficients[i][0] = coefs[i * 2];
+        result.channelInfo.coefficients[i][1] = coefs[i * 2 + 1];
+    }
+
+    if (pool && blockCount > 1 && blockSizeSamples % 14 == 0) {
+        encodeBlocksParallel(pcm, sampleCount, dst, blockSizeSamples, result.channelInfo.coefficients, preset, sorted,
+                             result.metrics, *pool);
+    } else {
+        int16_t yn1 = 0, yn2 = 0;
+        dspadpcm::encode(pcm, dst, yn1, yn2, result.channelInfo.coefficients, sampleCount, preset, sorted,
+                         &result.metrics);
+    }
+
+    for (size_t i = 0; i < order.size(); i++) {
+        captures[order[i]] = sorted[i];
+    }
+
+    result.channelInfo.startContext = toContext(captures[0]);
+    if (loopStart) {
+        result.channelInfo.loopContext = toContext(captures[loopIndex]);
+    }
+    result.seekHistory.resize(blockCount);
+    for (uint32_t block = 0; block < blockCount; block++) {
+        result.seekHistory[block] = {captures[blockIndex + block].yn1, captures[blockIndex + block].yn2};
+    }
+    result.regionContexts.resize(regions.size());
+    for (size_t region = 0; region < regions.size(); region++) {
+        result.regionContexts[region] = toContext(captures[regionIndex + region]);
+    }
+    return result;
+}
+
+std::vector<dspadpcm::HistoryCapture> getBfstmBlockCaptures(uint32_t blockStart, uint32_t sampleCount,
+                                                            BfstmDSPADPCMChannelInfo &channelInfo,
+                                                            std::optional<uint32_t> loopStart,
+                                                            std::span<const BfstmRegionInfo> regions,
+                                                            std::span<DSPAdpcmContext> regionContexts,
+                                                            std::vector<DSPAdpcmContext *> &targets) {
+    std::vector<dspadpcm::HistoryCapture> captures;
+    std::vector<DSPAdpcmContext *> unsortedTargets;
+    auto addCapture = [&](uint32_t sample, DSPAdpcmContext &target) {
+        if (sample < blockStart || sample >= blockStart + sampleCount) return;
+        captures.push_back({.sample = sample - blockStart, .header = 0, .yn1 = 0, .yn2 = 0});
+        unsortedTargets.push_back(&target);
+    };
+    addCapture(0, channelInfo.startContext);
+    if (loopStart) addCapture(*loopStart, channelInfo.loopContext);
+    for (size_t region = 0; region < regions.size(); region++) {
+        addCapture(regions[region].startSample, regionContexts[region]);
+    }
+
+    // The encoder needs the positions in order
+    std::vector<size_t> order(captures.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return captures[a].sample < captures[b].sample;
+    });
+    std::vector<dspadpcm::HistoryCapture> sorted(captures.size());
+    targets.resize(captures.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        sorted[i] = captures[order[i]];
+        targets[i] = unsortedTargets[order[i]];
+    }
+    return sorted;
+}
+
+void applyBfstmBlockCaptures(std::span<const dspadpcm::HistoryCapture> captures,
+                             std::span<DSPAdpcmContext *const> targets) {
+    for (size_t i = 0; i < captures.size(); i++) {
+        *targets[i] = toContext(captures[i]);
+    }
+}
+
+void encodeBfstmBlock(const int16_t *pcm, uint32_t sampleCount, uint32_t blockStart, uint8_t *dst, int16_t &yn1,
+                      int16_t &yn2, BfstmDSPADPCMChannelInfo &channelInfo, std::optional<uint32_t> loopStart,
+                      std::span<const BfstmRegionInfo> regions, std::span<DSPAdpcmContext> regionContexts,
+                      dspadpcm::EncodePreset preset, EncodeMetrics *metrics) {
+    std::vector<DSPAdpcmContext *> targets;
+    auto captures = getBfstmBlockCaptures(blockStart, sampleCount, channelInfo, loopStart, regions, regionContexts,
+                                          targets);
+    dspadpcm::encode(pcm, dst, yn1, yn2, channelInfo.coefficients, sampleCount, preset, captures, metrics);
+    applyBfstmBlockCaptures(captures, targets);
+}
@@ -0,0 +1,108 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+#include "BfstmFile.h"
+#include "../../codec/DspADPCM.h"
+#include "../../codec/EncodeMetrics.h"
+
+class ThreadPool;
+
+struct BfstmChannelEncodeResult {
+    BfstmDSPADPCMChannelInfo channelInfo{};
+    // History at the start of every block, the seek section entries of this channel
+    std::vector<BfstmHistoryInfo> seekHistory{};
+    // Context at the start sample of every region
+    std::vector<DSPAdpcmContext> regionContexts{};
+    EncodeMetrics metrics{};
+};
+
+/**
+ * Encodes one channel to dsp-adpcm. The start, loop, region and seek contexts are captured while the encoder passes
+ * the positions, the quality metrics are accumulated from the reconstructed samples. No second decode over the output
+ * is needed.
+ * @param pcm The samples of the channel
+ * @param dst Buffer with dspadpcm::getBytesForSamples(sampleCount) bytes, the frames are written contiguously
+ * @param blockSizeSamples Samples per block, one seek history entry is captured per block
+ * @param loopStart The loop start if the stream loops
+ * @param regions The regions of the stream
+ * @param pool If given, the blocks are encoded speculatively in parallel and reconciled afterwards. The output is
+ * identical to the serial encode. blockSizeSamples must be a multiple of 14, otherwise the serial encoder is used.
+ */
+BfstmChannelEncodeResult encodeBfstmChannel(const int16_t *pcm, uint32_t sampleCount, uint8_t *dst,
+                                            uint32_t blockSizeSamples, std::optional<uint32_t> loopStart,
+                                            std::span<const BfstmRegionInfo> regions,
+                                            dspadpcm::EncodePreset preset = dspadpcm::EncodePreset::EXHAUSTIVE,
+                                            ThreadPool *pool = nullptr);
+
+/**
+ * Encodes one block of a dsp-adpcm channel for block by block writing. The start, loop and region contexts whose
+ * sample lies in the block are filled in.
+ * @param blockStart The first sample of the block in the stream
+ * @param yn1 The history before the block, updated to the history after it
+ * @param regionContexts One context per region
+ */
+void encodeBfstmBlock(const int16_t *pcm, uint32_t sampleCount, uint32_t blockStart, uint8_t *dst, int16_t &yn1,
+                      int16_t &yn2, BfstmDSPADPCMChannelInfo &channelInfo, std::optional<uint32_t> loopStart,
+                      std::span<const BfstmRegionInfo> regions, std::span<DSPAdpcmContext> regionContexts,
+                      dspadpcm::EncodePreset preset, EncodeMetrics *metrics = nullptr);
+
+/**
+ * The start, loop and region positions that lie in a block, relative to the block start and sorted for the encoder.
+ * @param targets Receives the context of every capture, it points into channelInfo and regionContexts
+ */
+std::vector<dspadpcm::HistoryCapture> getBfstmBlockCaptures(uint32_t blockStart, uint32_t sampleCount,
+                                                            BfstmDSPADPCMChannelInfo &channelInfo,
+                                                            std::optional<uint32_t> loopStart,
+                                                            std::span<const BfstmRegionInfo> regions,
+                                                            std::span<DSPAdpcmContext> regionContexts,
+                                                            std::vector<DSPAdpcmContext *> &targets);
+
+/**
+ * Writes the encoded captures to their contexts, see getBfstmBlockCaptures.
+ */
+void applyBfstmBlockCaptures(std::span<const dspadpcm::HistoryCapture> captures,
+                             std::span<DSPAdpcmContext *const> targets);
+
+/**
+ * A dsp-adpcm block that was encoded with the source samples before it as history instead of the decoded ones, so
+ * the blocks of a channel can be encoded in parallel. reconcileBfstmBlock makes it identical to the serial encode.
+ */
+struct BfstmSpeculativeBlock {
+    // The history the block was encoded from and the history after it
+    BfstmHistoryInfo startHistory{};
+    BfstmHistoryInfo endHistory{};
+    // Metrics of the first frames and of the rest, the first frames are usually encoded again when reconciling
+    EncodeMetrics head{};
+    EncodeMetrics tail{};
+    // Positions inside the block, relative to the block start and sorted
+    std::vector<dspadpcm::HistoryCapture> captures{};
+};
+
+/**
+ * Encodes one block speculatively.
+ * @param dst Buffer with dspadpcm::getBytesForSamples(sampleCount) bytes
+ * @param history The source samples before the block, zero for the first block
+ * @param captures Positions relative to the block start and sorted
+ */
+BfstmSpeculativeBlock encodeBfstmBlockSpeculative(const int16_t *pcm, uint32_t sampleCount, uint8_t *dst,
+                                                  BfstmHistoryInfo history, const int16_t coefs[8][2],
+                                                  dspadpcm::EncodePreset preset,
+                                                  std::vector<dspadpcm::HistoryCapture> captures);
+
+/**
+ * Encodes the first frames of a speculative block again from the real history until it matches the speculative
+ * history, from there on the encoder output is identical. Reconciliation usually ends within a few frames. Afterwards
+ * dst and the captures of the block are the same as with a serial encode. Blocks must be reconciled in order.
+ * @param yn1 The real history before the block, updated to the history after it
+ * @param metrics The metrics of the block are added to it
+ */
+void reconcileBfstmBlock(const int16_t *pcm, uint32_t sampleCount, uint8_t *dst, int16_t &yn1, int16_t &yn2,
+                         const int16_t coefs[8][2], dspadpcm::EncodePreset preset, BfstmSpeculativeBlock &block,
+                         EncodeMetrics &metrics);
@@ -5,7 +5,9 @@
 #pragma once
 
 #include <cstdint>
+#include <optional>
 #include <ostream>
+#include <variant>
 #include <vector>
 #include "../../BfFile.h"
 
@@ -43,8 +45,14 @@ struct BfstmDSPADPCMChannelInfo {
     DSPAdpcmContext loopContext;
 };
 
-struct BfstmIMAADPCMChannelInfo {
+struct IMAAdpcmContext {
+    int16_t predictor;
+    uint8_t stepIndex;
+};
 
+struct BfstmIMAADPCMChannelInfo {
+    IMAAdpcmContext startContext;
+    IMAAdpcmContext loopContext;
 };
 
 struct BfstmChannelInfo {
@@ -65,6 +73,8 @@ struct BfstmTrackInfo {
     uint16_t channelIndexTableFlag;
     uint16_t _u0;
     int32_t channelIndexTableOffset;
+    // The stream channels of this track, read from the channel index table
+    std::vector<uint8_t> channelIndices{};
 };
 
 // TODO Code in smo returns dspadpcm if encoding >= 3
@@ -157,6 +167,12 @@ struct BfstmHeader {
     }
 
     [[nodiscard]] bool verifyHeader() const;
+
+    // The bom is read in native order, so it is only swapped if the file has the other byte order. Pcm16 sample data
+    // has to be swapped then.
+    [[nodiscard]] bool isByteOrderSwapped() const {
+        return bom == 0xFFFE;
+    }
 };
 
 struct BfstmContext {
@@ -165,10 +181,14 @@ struct BfstmContext {
     BfstmStreamInfo streamInfo{};
     std::vector<BfstmTrackInfo> trackInfos{};
     std::vector<std::variant<BfstmDSPADPCMChannelInfo, BfstmIMAADPCMChannelInfo>> channelInfos{};
+    // File offset of the adpcm info of every channel, set by the reader so the contexts can be patched in place
+    std::vector<uint32_t> channelInfoOffsets{};
     std::vector<std::pair<BfstmRegionInfo, std::vector<DSPAdpcmContext>>> regionInfos{};
+    // History before every block, indexed by block * channelNum + channel. Empty if the stream has no valid seek
+    // section, then blocks can only be decoded from the stream start.
+    std::vector<BfstmHistoryInfo> seekTable{};
 };
 
-// TODO Regions
 // Info the user inputs for encoding to bfstm
 struct BfstmWriteInfo {
     SoundEncoding encoding;
@@ -177,6 +197,14 @@ struct BfstmWriteInfo {
     uint32_t sampleRate;
     uint32_t loopStart;
     uint32_t loopEnd;
+    // Samples per channel of the whole stream
+    uint32_t sampleCount;
+    uint32_t blockSizeBytes = 0x2000;
+    // Needed for dsp-adpcm and ima-adpcm. For dsp-adpcm pcm input the coefficients are used for encoding, the
+    // contexts are filled in by the writer.
+    std::vector<std::variant<BfstmDSPADPCMChannelInfo, BfstmIMAADPCMChannelInfo>> channelInfos{};
+    // The contexts are filled in by the writer for dsp-adpcm pcm input
+    std::vector<std::pair<BfstmRegionInfo, std::vector<DSPAdpcmContext>>> regionInfos{};
+    // Only volume, pan, span, flags and the channel indices are written
+    std::vector<BfstmTrackInfo> trackInfos{};
 };
-
-void writeBfstm(OutMemoryStream &stream, const BfstmWriteInfo& writeInfo);
\ No newline at end of file
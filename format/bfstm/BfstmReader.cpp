@@ -5,6 +5,7 @@
 #include <variant>
 #include "BfstmReader.h"
 #include "BfstmFile.h"
+#include "../../codec/Crc32.h"
 
 BfstmReader::BfstmReader(const MemoryResource &resource) : m_Stream(resource) {
     if (!readBfstm()) {
@@ -13,16 +14,18 @@ BfstmReader::BfstmReader(const MemoryResource &resource) : m_Stream(resource) {
 }
 
 std::optional<std::variant<BfstmDSPADPCMChannelInfo, BfstmIMAADPCMChannelInfo>>
-readChannelInfo(InMemoryStream &stream, SoundEncoding encoding) {
+readChannelInfo(InMemoryStream &stream, SoundEncoding encoding, uint32_t &codecInfoOffset) {
     size_t current = stream.tell();
     uint16_t flag = stream.readU16();
-    if (flag != 0x0300) {
+    uint16_t expectedFlag = encoding == SoundEncoding::IMA_ADPCM ? 0x0301 : 0x0300;
+    if (flag != expectedFlag) {
         std::cerr << "Channel info flag invalid!" << std::hex << flag << std::endl;
         return std::nullopt;
     }
     stream.skip(2);
     int32_t off = stream.readS32();
     stream.seek(current + off);
+    codecInfoOffset = stream.tell();
     if (encoding == SoundEncoding::DSP_ADPCM) {
         BfstmDSPADPCMChannelInfo dsp{};
         for (auto &coefficient: dsp.coefficients) {
@@ -37,21 +40,37 @@ readChannelInfo(InMemoryStream &stream, SoundEncoding encoding) {
         dsp.loopContext.yn2 = stream.readS16();
         return {dsp};
     } else if (encoding == SoundEncoding::IMA_ADPCM) {
-        std::cerr << "IMA ADPCM Channel Info not yet supported!" << std::endl;
-        return {};
+        BfstmIMAADPCMChannelInfo ima{};
+        ima.startContext.predictor = stream.readS16();
+        ima.startContext.stepIndex = stream.readU8();
+        stream.skip(1);
+        ima.loopContext.predictor = stream.readS16();
+        ima.loopContext.stepIndex = stream.readU8();
+        stream.skip(1);
+        return {ima};
     } else {
         return {};
     }
 }
 
 BfstmTrackInfo readTrackInfo(InMemoryStream &stream) {
+    size_t current = stream.tell();
     BfstmTrackInfo info{};
     info.volume = stream.readU8();
     info.pan = stream.readU8();
+    info.span = stream.readU8();
     info.flags = stream.readU8();
     info.channelIndexTableFlag = stream.readU16();
     stream.skip(2);
     info.channelIndexTableOffset = stream.readS32();
+    if (info.channelIndexTableFlag == 0x0100) {
+        // Relative to the track info
+        stream.seek(current + info.channelIndexTableOffset);
+        uint32_t count = stream.readU32();
+        for (uint32_t i = 0; i < count; ++i) {
+            info.channelIndices.push_back(stream.readU8());
+        }
+    }
     return info;
 }
 
@@ -140,8 +159,30 @@ void BfstmReader::readStreamInfo() {
     }
 }
 
+void BfstmReader::readSeekTable(const BfstmSeek &seek) {
+    const auto &streamInfo = m_Context.streamInfo;
+    if (seek.magic != 0x4b454553) {
+        std::cerr << "Seek section invalid!" << std::endl;
+        return;
+    }
+    if (streamInfo.soundEncoding != SoundEncoding::DSP_ADPCM) return;
+    uint32_t entrySize = streamInfo.channelSeekInfoSize;
+    uint64_t entryCount = static_cast<uint64_t>(streamInfo.blockCountPerChannel) * streamInfo.channelNum;
+    if (entrySize < 4 || 0x8 + entryCount * entrySize > seek.sectionSize) {
+        std::cerr << "Warning: Seek section does not fit " << streamInfo.blockCountPerChannel << " blocks with "
+                  << entrySize << " bytes per channel, blocks are decoded from the stream start." << std::endl;
+        return;
+    }
+    size_t start = m_Stream.tell();
+    m_Context.seekTable.resize(entryCount);
+    for (uint32_t i = 0; i < entryCount; ++i) {
+        m_Stream.seek(start + i * entrySize);
+        m_Context.seekTable[i].histSample1 = m_Stream.readS16();
+        m_Context.seekTable[i].histSample2 = m_Stream.readS16();
+    }
+}
+
 bool BfstmReader::readBfstm() {
-    // TODO crc32check available from version 5
     if (!readHeader()) {
         return false;
     }
@@ -177,12 +218,13 @@ bool BfstmReader::readBfstm() {
             std::cout << "Warning: Track info has more than 8 references, but only 8 are supported." << std::endl;
             refCount = 8;
         }
-        auto offsets = std::vector<int32_t>(refCount);
+        auto offsets = std::vector<int32_t>();
         for (int i = 0; i < refCount; ++i) {
             auto refEntry = readReferenceEntry(m_Stream);
-            std::cout << std::hex << refEntry.flag << std::endl;
             if (refEntry.flag == 0x4101) {
-                offsets[i] = refEntry.offset;
+                offsets.push_back(refEntry.offset);
+            } else {
+                std::cerr << "Unknown entry flag in track info array" << refEntry.flag << std::endl;
             }
         }
         for (auto offset: offsets) {
@@ -209,7 +251,10 @@ bool BfstmReader::readBfstm() {
         }
         for (auto offset: offsets) {
             m_Stream.seek(startOff + offset);
-            m_Context.channelInfos.emplace_back(readChannelInfo(m_Stream, streamInfo.soundEncoding).value());
+            uint32_t codecInfoOffset = 0;
+            m_Context.channelInfos.emplace_back(
+                    readChannelInfo(m_Stream, streamInfo.soundEncoding, codecInfoOffset).value());
+            m_Context.channelInfoOffsets.push_back(codecInfoOffset);
         }
     }
 
@@ -247,6 +292,7 @@ bool BfstmReader::readBfstm() {
         BfstmSeek seek{};
         seek.magic = m_Stream.readU32();
         seek.sectionSize = m_Stream.readU32();
+        readSeekTable(seek);
     }
 
     m_Stream.seek(header.dataSection->offset);
@@ -254,5 +300,32 @@ bool BfstmReader::readBfstm() {
     data.magic = m_Stream.readU32();
     data.sectionSize = m_Stream.readU32();
 
+    if (header.version >= 0x50000 && streamInfo.checksum != 0) {
+        checksumValid = verifyChecksum();
+    }
+    return true;
+}
+
+bool BfstmReader::verifyChecksum() {
+    const auto &header = m_Context.header;
+    const auto &streamInfo = m_Context.streamInfo;
+    uint32_t start = header.dataSection->offset + 0x8 + streamInfo.sampleDataOffset;
+    uint32_t end = header.dataSection->offset + header.dataSection->size;
+    if (start > end) {
+        std::cerr << "Data section is smaller than its header!" << std::endl;
+        return false;
+    }
+    try {
+        m_Stream.seek(end);
+    } catch (const std::out_of_range &) {
+        std::cerr << "Data section exceeds the file!" << std::endl;
+        return false;
+    }
+    uint32_t crc = crc32::compute(m_Stream.getSpanAt(start, end - start).data(), end - start);
+    if (crc != streamInfo.checksum) {
+        std::cerr << "Checksum mismatch! Expected 0x" << std::hex << streamInfo.checksum << ", got 0x" << crc
+                  << std::dec << std::endl;
+        return false;
+    }
     return true;
 }
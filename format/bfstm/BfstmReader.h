@@ -18,8 +18,17 @@ public:
 
     void readStreamInfo();
 
+    void readSeekTable(const BfstmSeek &seek);
+
+    /**
+     * Compares the checksum of the stream info (version 5 and later) with the crc32 of the sample data.
+     */
+    bool verifyChecksum();
+
     BfstmContext m_Context;
     bool success = true;
+    // false if the stream has a checksum that does not match its sample data
+    bool checksumValid = true;
 private:
     InMemoryStream m_Stream;
 };
@@ -0,0 +1,112 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <array>
+#include <iostream>
+#include "BfstmSeekIndex.h"
+#include "BfstmFile.h"
+#include "../../codec/DspADPCM.h"
+
+BfstmSeekIndex::BfstmSeekIndex(const BfstmContext &context, const void *dataPtr, uint32_t interval)
+        : m_Context(context), m_Blocks(context, dataPtr) {
+    const auto &streamInfo = context.streamInfo;
+    m_Interval = std::max<uint32_t>((interval + 13) / 14 * 14, 14);
+    m_ChannelNum = streamInfo.channelNum;
+    m_EntriesPerBlock = (streamInfo.blockSizeSamples + m_Interval - 1) / m_Interval;
+    if (streamInfo.soundEncoding != SoundEncoding::DSP_ADPCM || streamInfo.blockCountPerChannel == 0) {
+        std::cerr << "Only dsp-adpcm streams with sample data can be indexed!" << std::endl;
+        success = false;
+        return;
+    }
+    m_Entries.resize(streamInfo.blockCountPerChannel * m_EntriesPerBlock * m_ChannelNum);
+    m_BlockState.resize(streamInfo.blockCountPerChannel, 0);
+    for (uint32_t ch = 0; ch < m_ChannelNum; ++ch) {
+        const auto &dsp = get<BfstmDSPADPCMChannelInfo>(context.channelInfos[ch]);
+        int16_t *yn = entry(0, 0, ch);
+        yn[0] = dsp.startContext.yn1;
+        yn[1] = dsp.startContext.yn2;
+    }
+    m_BlockState[0] = 1;
+}
+
+void BfstmSeekIndex::build() {
+    std::lock_guard guard{m_Mutex};
+    for (uint32_t block = 0; block < m_BlockState.size(); ++block) {
+        if (m_BlockState[block] != 2) buildBlock(block);
+    }
+}
+
+void BfstmSeekIndex::buildBlock(uint32_t block) {
+    const BfstmBlock blockInfo = m_Blocks[block];
+    if (m_BlockState[block] == 0) {
+        if (blockInfo.history) {
+            for (uint32_t ch = 0; ch < m_ChannelNum; ++ch) {
+                auto hist = blockInfo.history[ch];
+                int16_t *yn = entry(block, 0, ch);
+                yn[0] = hist.histSample1;
+                yn[1] = hist.histSample2;
+            }
+            m_BlockState[block] = 1;
+        } else {
+            // Walk forward from the last block whose start history is known
+            uint32_t known = block;
+            while (m_BlockState[known] == 0) --known;
+            for (; known < block; ++known) {
+                if (m_BlockState[known] != 2) buildBlock(known);
+            }
+        }
+    }
+
+    bool isLast = blockInfo.isLast;
+    uint32_t frameCount = blockInfo.sampleCount;
+    auto scratch = std::make_unique_for_overwrite<int16_t[]>(m_Interval);
+
+    for (uint32_t ch = 0; ch < m_ChannelNum; ++ch) {
+        const auto &dsp = get<BfstmDSPADPCMChannelInfo>(m_Context.channelInfos[ch]);
+        int16_t yn1 = entry(block, 0, ch)[0];
+        int16_t yn2 = entry(block, 0, ch)[1];
+        for (uint32_t e = 0; e < m_EntriesPerBlock; ++e) {
+            uint32_t first = e * m_Interval;
+            int16_t *yn = entry(block, e, ch);
+            yn[0] = yn1;
+            yn[1] = yn2;
+            if (first >= frameCount) continue;
+            dspadpcm::decode(blockInfo.getChannelPtr(ch) + first / 14 * 8, scratch.get(), yn1, yn2,
+                             dsp.coefficients, std::min(m_Interval, frameCount - first), 0);
+        }
+        if (!isLast && m_BlockState[block + 1] == 0) {
+            int16_t *next = entry(block + 1, 0, ch);
+            next[0] = yn1;
+            next[1] = yn2;
+        }
+    }
+    if (!isLast && m_BlockState[block + 1] == 0) m_BlockState[block + 1] = 1;
+    m_BlockState[block] = 2;
+}
+
+bool BfstmSeekIndex::getDspYn(uint32_t sample, std::shared_ptr<int16_t[][2]> &dspYn) {
+    if (!success) return false;
+    const auto &streamInfo = m_Context.streamInfo;
+    std::lock_guard guard{m_Mutex};
+    uint32_t block = std::min(sample / streamInfo.blockSizeSamples, streamInfo.blockCountPerChannel - 1);
+    uint32_t inBlock = sample - block * streamInfo.blockSizeSamples;
+    if (m_BlockState[block] != 2) buildBlock(block);
+
+    const BfstmBlock blockInfo = m_Blocks[block];
+    uint32_t e = std::min(inBlock / m_Interval, m_EntriesPerBlock - 1);
+    uint32_t first = e * m_Interval;
+    // Decode up to the start of the frame containing the sample
+    uint32_t toDecode = inBlock / 14 * 14 - first;
+    auto scratch = std::make_unique_for_overwrite<int16_t[]>(std::max(toDecode, 1u));
+    for (uint32_t ch = 0; ch < m_ChannelNum; ++ch) {
+        int16_t *yn = entry(block, e, ch);
+        dspYn[ch][0] = yn[0];
+        dspYn[ch][1] = yn[1];
+        if (toDecode == 0) continue;
+        const auto &dsp = get<BfstmDSPADPCMChannelInfo>(m_Context.channelInfos[ch]);
+        dspadpcm::decode(blockInfo.getChannelPtr(ch) + first / 14 * 8, scratch.get(), dspYn[ch][0], dspYn[ch][1],
+                         dsp.coefficients, toDecode, 0);
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "BfstmBlocks.h"
+
+/**
+ * In-memory index of the dsp-adpcm history (yn1/yn2) of every channel at a fixed sample interval inside each block.
+ * With it, any sample can be reached with at most one interval of decode work instead of decoding from the block start.
+ * Entries are either built by one decode pass (build()) or lazily on first touch. This class is thread safe.
+ */
+class BfstmSeekIndex {
+public:
+    /**
+     * @param context The stream context, must be dsp-adpcm encoded and outlive the index. Its seek table lets blocks
+     * be indexed independently.
+     * @param dataPtr Pointer to the sample data (same as for AudioPlayback::play)
+     * @param interval Sample interval between entries. Rounded up to a whole dsp-adpcm frame (14 samples).
+     * success is false for streams without blocks or other encodings.
+     */
+    BfstmSeekIndex(const BfstmContext &context, const void *dataPtr, uint32_t interval = 1024);
+
+    /**
+     * Indexes all blocks in a single decode pass.
+     */
+    void build();
+
+    /**
+     * Fills dspYn with the history of every channel at the start of the frame that contains sample.
+     * Decodes at most one interval. sample must lie in the stream.
+     * @return false if the index could not be created
+     */
+    bool getDspYn(uint32_t sample, std::shared_ptr<int16_t[][2]> &dspYn);
+
+    [[nodiscard]] uint32_t getInterval() const {
+        return m_Interval;
+    }
+
+    bool success = true;
+
+private:
+    void buildBlock(uint32_t block);
+
+    int16_t *entry(uint32_t block, uint32_t entryIdx, uint32_t channel) {
+        return m_Entries[(block * m_EntriesPerBlock + entryIdx) * m_ChannelNum + channel].data();
+    }
+
+    const BfstmContext &m_Context;
+    BfstmBlockRange m_Blocks;
+    uint32_t m_Interval;
+    uint32_t m_ChannelNum;
+    uint32_t m_EntriesPerBlock;
+    // (block, entry, channel) -> yn1, yn2
+    std::vector<std::array<int16_t, 2>> m_Entries;
+    // 0 = unknown, 1 = block start history known, 2 = block fully indexed
+    std::vector<uint8_t> m_BlockState;
+    std::mutex m_Mutex;
+};
@@ -0,0 +1,487 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <algorithm>
+#include <iostream>
+#include "BfstmWriter.h"
+#include "BfstmEncoder.h"
+#include "../../MemoryResource.h"
+
+static constexpr uint32_t streamInfoSize = 0x50;
+static constexpr uint32_t dspAdpcmInfoSize = 0x2E;
+static constexpr uint32_t imaAdpcmInfoSize = 0x8;
+static constexpr uint32_t regionInfoSize = 0x100;
+static constexpr uint32_t sampleDataOffset = 0x18;
+
+static uint32_t align(uint32_t value, uint32_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool verifyWriteInfo(const BfstmWriteInfo &writeInfo) {
+    if (writeInfo.encoding > SoundEncoding::IMA_ADPCM) {
+        std::cerr << "Cannot write unknown encoding " << static_cast<int>(writeInfo.encoding) << std::endl;
+        return false;
+    }
+    if (writeInfo.channelNum == 0 || writeInfo.sampleCount == 0) {
+        std::cerr << "Stream has no channels or samples!" << std::endl;
+        return false;
+    }
+    if (writeInfo.blockSizeBytes == 0 || writeInfo.blockSizeBytes % 0x20 != 0) {
+        std::cerr << "Block size must be a multiple of 0x20!" << std::endl;
+        return false;
+    }
+    if (writeInfo.isLoop && (writeInfo.loopStart >= writeInfo.loopEnd || writeInfo.loopEnd > writeInfo.sampleCount)) {
+        std::cerr << "Loop " << writeInfo.loopStart << " - " << writeInfo.loopEnd << " is invalid!" << std::endl;
+        return false;
+    }
+    bool isAdpcm = writeInfo.encoding == SoundEncoding::DSP_ADPCM || writeInfo.encoding == SoundEncoding::IMA_ADPCM;
+    if (isAdpcm && writeInfo.channelInfos.size() != writeInfo.channelNum) {
+        std::cerr << "Expected " << static_cast<int>(writeInfo.channelNum) << " channel infos, got "
+                  << writeInfo.channelInfos.size() << std::endl;
+        return false;
+    }
+    if (writeInfo.regionInfos.size() > 0xFF || (!writeInfo.regionInfos.empty() && writeInfo.channelNum > 16)) {
+        std::cerr << "Regions support up to 255 entries with up to 16 channels!" << std::endl;
+        return false;
+    }
+    if (writeInfo.channelNum != 1 && writeInfo.channelNum % 2 != 0) {
+        std::cout << "Warning: Odd channel count " << static_cast<int>(writeInfo.channelNum) << std::endl;
+    }
+    constexpr std::array<uint32_t, 3> usedRates{22000, 32000, 48000};
+    if (std::find(usedRates.begin(), usedRates.end(), writeInfo.sampleRate) == usedRates.end()) {
+        std::cout << "Warning: Sample rate " << writeInfo.sampleRate << " is not used by the games." << std::endl;
+    }
+    return true;
+}
+
+BfstmWriter::BfstmWriter(std::ostream &out, BfstmWriteInfo writeInfo, dspadpcm::EncodePreset preset)
+        : m_Out(out), m_WriteInfo(std::move(writeInfo)), m_Preset(preset) {
+    if (!verifyWriteInfo(m_WriteInfo)) {
+        success = false;
+        return;
+    }
+    const uint32_t blockSizeBytes = m_WriteInfo.blockSizeBytes;
+    switch (m_WriteInfo.encoding) {
+        case SoundEncoding::PCM8:
+            m_BlockSizeSamples = blockSizeBytes;
+            break;
+        case SoundEncoding::PCM16:
+            m_BlockSizeSamples = blockSizeBytes / 2;
+            break;
+        case SoundEncoding::DSP_ADPCM:
+            m_BlockSizeSamples = blockSizeBytes / 8 * 14;
+            break;
+        case SoundEncoding::IMA_ADPCM:
+            m_BlockSizeSamples = blockSizeBytes * 2;
+            break;
+    }
+    const uint32_t channelNum = m_WriteInfo.channelNum;
+    m_BlockCount = (m_WriteInfo.sampleCount + m_BlockSizeSamples - 1) / m_BlockSizeSamples;
+    m_LastBlockSizeBytes = getBytesForSamples(m_WriteInfo.sampleCount - (m_BlockCount - 1) * m_BlockSizeSamples);
+    m_LastBlockSizeBytesRaw = align(m_LastBlockSizeBytes, 0x20);
+
+    bool hasSeek = m_WriteInfo.encoding == SoundEncoding::DSP_ADPCM;
+    bool hasRegion = !m_WriteInfo.regionInfos.empty();
+    uint32_t sectionCount = 2 + hasSeek + hasRegion;
+    m_HeaderSize = align(0x14 + sectionCount * 0xC, 0x20);
+
+    uint32_t channelInfoSize = 4 + channelNum * 0x10;
+    if (m_WriteInfo.encoding == SoundEncoding::DSP_ADPCM) channelInfoSize += channelNum * dspAdpcmInfoSize;
+    if (m_WriteInfo.encoding == SoundEncoding::IMA_ADPCM) channelInfoSize += channelNum * imaAdpcmInfoSize;
+    m_InfoSize = align(0x8 + 0x18 + streamInfoSize + getTrackInfoSize() + channelInfoSize, 0x20);
+
+    uint32_t offset = m_HeaderSize + m_InfoSize;
+    if (hasSeek) {
+        m_SeekOffset = offset;
+        m_SeekSize = align(0x8 + m_BlockCount * channelNum * 4, 0x20);
+        offset += m_SeekSize;
+    }
+    if (hasRegion) {
+        m_RegionOffset = offset;
+        m_RegionSize = align(0x8 + sampleDataOffset + m_WriteInfo.regionInfos.size() * regionInfoSize, 0x20);
+        offset += m_RegionSize;
+    }
+    m_DataOffset = offset;
+    m_DataSize = 0x8 + sampleDataOffset + (m_BlockCount - 1) * channelNum * blockSizeBytes +
+                 channelNum * m_LastBlockSizeBytesRaw;
+
+    m_SeekTable.resize(hasSeek ? m_BlockCount * channelNum : 0);
+    m_Yn.resize(channelNum);
+    m_Metrics.resize(channelNum);
+    if (m_WriteInfo.encoding == SoundEncoding::DSP_ADPCM) {
+        for (uint32_t ch = 0; ch < channelNum; ++ch) {
+            const auto &dsp = get<BfstmDSPADPCMChannelInfo>(m_WriteInfo.channelInfos[ch]);
+            m_Yn[ch] = {dsp.startContext.yn1, dsp.startContext.yn2};
+        }
+    }
+    for (auto &[region, contexts]: m_WriteInfo.regionInfos) {
+        contexts.resize(channelNum);
+        m_Regions.push_back(region);
+    }
+
+    writeLayout();
+    m_Out.seekp(m_DataOffset + 0x8 + sampleDataOffset);
+    if (!m_Out) {
+        std::cerr << "Cannot write bfstm layout!" << std::endl;
+        success = false;
+    }
+}
+
+uint32_t BfstmWriter::getTrackInfoSize() const {
+    if (m_WriteInfo.trackInfos.empty()) return 0;
+    uint32_t size = 4 + m_WriteInfo.trackInfos.size() * 0x8;
+    for (const auto &track: m_WriteInfo.trackInfos) {
+        size += 0xC + align(4 + track.channelIndices.size(), 4);
+    }
+    return size;
+}
+
+uint32_t BfstmWriter::getBytesForSamples(uint32_t sampleCount) const {
+    switch (m_WriteInfo.encoding) {
+        case SoundEncoding::PCM8:
+            return sampleCount;
+        case SoundEncoding::PCM16:
+            return sampleCount * 2;
+        case SoundEncoding::DSP_ADPCM:
+            return dspadpcm::getBytesForSamples(sampleCount);
+        case SoundEncoding::IMA_ADPCM:
+            return (sampleCount + 1) / 2;
+        default:
+            return 0;
+    }
+}
+
+bool BfstmWriter::checkBlock(uint32_t sampleCount) {
+    if (!success) return false;
+    if (m_NextBlock >= m_BlockCount) {
+        std::cerr << "All " << m_BlockCount << " blocks are already written!" << std::endl;
+        return false;
+    }
+    bool isLast = m_NextBlock + 1 == m_BlockCount;
+    uint32_t expected = isLast ? m_WriteInfo.sampleCount - m_NextBlock * m_BlockSizeSamples : m_BlockSizeSamples;
+    if (sampleCount != expected) {
+        std::cerr << "Block " << m_NextBlock << " has " << sampleCount << " samples, expected " << expected << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void BfstmWriter::writeBlockData(const uint8_t *data, uint32_t bytes, uint32_t paddedBytes) {
+    m_Out.write(reinterpret_cast<const char *>(data), bytes);
+    for (uint32_t i = bytes; i < paddedBytes; ++i) {
+        m_Out.put(0);
+    }
+}
+
+bool BfstmWriter::writeBlock(const int16_t *const *channels, uint32_t sampleCount) {
+    if (!checkBlock(sampleCount)) return false;
+    if (m_WriteInfo.encoding == SoundEncoding::IMA_ADPCM) {
+        std::cerr << "Ima-adpcm can only be written from encoded blocks!" << std::endl;
+        return false;
+    }
+    const uint32_t channelNum = m_WriteInfo.channelNum;
+    const uint32_t blockStart = m_NextBlock * m_BlockSizeSamples;
+    bool isLast = m_NextBlock + 1 == m_BlockCount;
+    uint32_t paddedBytes = isLast ? m_LastBlockSizeBytesRaw : m_WriteInfo.blockSizeBytes;
+    uint32_t bytes = getBytesForSamples(sampleCount);
+    m_BlockBuffer.resize(paddedBytes);
+
+    for (uint32_t ch = 0; ch < channelNum; ++ch) {
+        switch (m_WriteInfo.encoding) {
+            case SoundEncoding::PCM8:
+                for (uint32_t i = 0; i < sampleCount; ++i) {
+                    m_BlockBuffer[i] = static_cast<uint8_t>(channels[ch][i] >> 8);
+                }
+                break;
+            case SoundEncoding::PCM16:
+                std::copy_n(reinterpret_cast<const uint8_t *>(channels[ch]), bytes, m_BlockBuffer.begin());
+                break;
+            case SoundEncoding::DSP_ADPCM: {
+                auto &[yn1, yn2] = m_Yn[ch];
+                m_SeekTable[m_NextBlock * channelNum + ch] = {yn1, yn2};
+                std::vector<DSPAdpcmContext> regionContexts;
+                for (const auto &[region, contexts]: m_WriteInfo.regionInfos) {
+                    regionContexts.push_back(contexts[ch]);
+                }
+                std::optional<uint32_t> loopStart;
+                if (m_WriteInfo.isLoop) loopStart = m_WriteInfo.loopStart;
+                encodeBfstmBlock(channels[ch], sampleCount, blockStart, m_BlockBuffer.data(), yn1, yn2,
+                                 get<BfstmDSPADPCMChannelInfo>(m_WriteInfo.channelInfos[ch]), loopStart, m_Regions,
+                                 regionContexts, m_Preset, &m_Metrics[ch]);
+                for (size_t region = 0; region < regionContexts.size(); ++region) {
+                    m_WriteInfo.regionInfos[region].second[ch] = regionContexts[region];
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        writeBlockData(m_BlockBuffer.data(), bytes, paddedBytes);
+    }
+    ++m_NextBlock;
+    if (!m_Out) {
+        std::cerr << "Cannot write block " << m_NextBlock - 1 << std::endl;
+        success = false;
+    }
+    return success;
+}
+
+bool BfstmWriter::writeEncodedBlock(const uint8_t *const *channels, uint32_t sampleCount,
+                                    const BfstmHistoryInfo *history) {
+    if (!checkBlock(sampleCount)) return false;
+    const uint32_t channelNum = m_WriteInfo.channelNum;
+    if (m_WriteInfo.encoding == SoundEncoding::DSP_ADPCM) {
+        if (!history) {
+            std::cerr << "Dsp-adpcm blocks need the history for the seek table!" << std::endl;
+            return false;
+        }
+        std::copy_n(history, channelNum, m_SeekTable.begin() + m_NextBlock * channelNum);
+    }
+    bool isLast = m_NextBlock + 1 == m_BlockCount;
+    uint32_t paddedBytes = isLast ? m_LastBlockSizeBytesRaw : m_WriteInfo.blockSizeBytes;
+    for (uint32_t ch = 0; ch < channelNum; ++ch) {
+        writeBlockData(channels[ch], getBytesForSamples(sampleCount), paddedBytes);
+    }
+    ++m_NextBlock;
+    if (!m_Out) {
+        std::cerr << "Cannot write block " << m_NextBlock - 1 << std::endl;
+        success = false;
+    }
+    return success;
+}
+
+void BfstmWriter::setDspContexts(uint8_t channel, const DSPAdpcmContext &start, const DSPAdpcmContext &loop,
+                                 std::span<const DSPAdpcmContext> regionContexts) {
+    if (m_WriteInfo.encoding != SoundEncoding::DSP_ADPCM || channel >= m_WriteInfo.channelNum ||
+        regionContexts.size() != m_WriteInfo.regionInfos.size()) {
+        std::cerr << "Cannot set the dsp-adpcm contexts of channel " << static_cast<int>(channel) << std::endl;
+        success = false;
+        return;
+    }
+    auto &dsp = get<BfstmDSPADPCMChannelInfo>(m_WriteInfo.channelInfos[channel]);
+    dsp.startContext = start;
+    dsp.loopContext = loop;
+    for (size_t region = 0; region < regionContexts.size(); ++region) {
+        m_WriteInfo.regionInfos[region].second[channel] = regionContexts[region];
+    }
+}
+
+bool BfstmWriter::finish() {
+    if (!success) return false;
+    if (m_NextBlock != m_BlockCount) {
+        std::cerr << "Only " << m_NextBlock << " of " << m_BlockCount << " blocks were written!" << std::endl;
+        return false;
+    }
+    auto end = m_Out.tellp();
+    writeLayout();
+    m_Out.seekp(end);
+    m_Out.flush();
+    if (!m_Out) {
+        std::cerr << "Cannot finish bfstm!" << std::endl;
+        success = false;
+    }
+    return success;
+}
+
+void BfstmWriter::writeLayout() {
+    MemoryResource resource{};
+    OutMemoryStream stream{resource};
+    bool hasSeek = m_SeekSize != 0;
+    bool hasRegion = m_RegionSize != 0;
+
+    stream.writeU32(0x4d545346);
+    stream.writeU16(0xfeff);
+    stream.writeU16(m_HeaderSize);
+    stream.writeU32(0x00060100);
+    stream.writeU32(m_DataOffset + m_DataSize);
+    stream.writeU16(2 + hasSeek + hasRegion);
+    stream.writeU16(0);
+    auto writeSection = [&stream](uint16_t flag, uint32_t offset, uint32_t size) {
+        stream.writeU16(flag);
+        stream.writeU16(0);
+        stream.writeS32(static_cast<int32_t>(offset));
+        stream.writeU32(size);
+    };
+    writeSection(0x4000, m_HeaderSize, m_InfoSize);
+    if (hasSeek) writeSection(0x4001, m_SeekOffset, m_SeekSize);
+    writeSection(0x4002, m_DataOffset, m_DataSize);
+    if (hasRegion) writeSection(0x4003, m_RegionOffset, m_RegionSize);
+    stream.fillToAlign(0x20);
+
+    writeInfoSection(stream);
+
+    if (hasSeek) {
+        stream.writeU32(0x4b454553);
+        stream.writeU32(m_SeekSize);
+        for (const auto &history: m_SeekTable) {
+            stream.writeS16(history.histSample1);
+            stream.writeS16(history.histSample2);
+        }
+        stream.fillToAlign(0x20);
+    }
+
+    if (hasRegion) {
+        stream.writeU32(0x4e474552);
+        stream.writeU32(m_RegionSize);
+        stream.writeNull(sampleDataOffset);
+        for (const auto &[region, contexts]: m_WriteInfo.regionInfos) {
+            size_t start = stream.tell();
+            stream.writeU32(region.startSample);
+            stream.writeU32(region.endSample);
+            for (const auto &context: contexts) {
+                stream.writeU16(context.header);
+                stream.writeS16(context.yn1);
+                stream.writeS16(context.yn2);
+            }
+            stream.writeNull(start + regionInfoSize - stream.tell());
+        }
+        stream.fillToAlign(0x20);
+    }
+
+    stream.writeU32(0x41544144);
+    stream.writeU32(m_DataSize);
+    stream.writeNull(sampleDataOffset);
+
+    m_Out.seekp(0);
+    m_Out.write(static_cast<const char *>(resource.getAsPtrUnsafe(0)), static_cast<std::streamsize>(stream.tell()));
+}
+
+void BfstmWriter::writeInfoSection(OutMemoryStream &stream) const {
+    uint32_t start = stream.tell();
+    stream.writeU32(0x4f464e49);
+    stream.writeU32(m_InfoSize);
+    // stream info
+    stream.writeU16(0x4100);
+    stream.writeU16(0);
+    stream.writeS32(0x18);
+    // track info
+    bool hasTracks = !m_WriteInfo.trackInfos.empty();
+    stream.writeU16(hasTracks ? 0x0101 : 0);
+    stream.writeU16(0);
+    stream.writeS32(hasTracks ? static_cast<int32_t>(0x18 + streamInfoSize) : -1);
+    // channel info
+    stream.writeU16(0x0101);
+    stream.writeU16(0);
+    stream.writeS32(static_cast<int32_t>(0x18 + streamInfoSize + getTrackInfoSize()));
+    writeStreamInfo(stream);
+    if (hasTracks) writeTrackInfo(stream);
+    writeChannelInfo(stream);
+    stream.writeNull(start + m_InfoSize - stream.tell());
+}
+
+void BfstmWriter::writeStreamInfo(OutMemoryStream &stream) const {
+    const uint32_t sampleCount = m_WriteInfo.sampleCount;
+    const uint32_t loopStart = m_WriteInfo.isLoop ? m_WriteInfo.loopStart : 0;
+    const uint32_t loopEnd = m_WriteInfo.isLoop ? m_WriteInfo.loopEnd : sampleCount;
+    stream.writeU8(static_cast<uint8_t>(m_WriteInfo.encoding));
+    stream.writeU8(m_WriteInfo.isLoop);
+    stream.writeU8(m_WriteInfo.channelNum);
+    stream.writeU8(m_WriteInfo.regionInfos.size());
+    stream.writeU32(m_WriteInfo.sampleRate);
+    stream.writeU32(loopStart);
+    stream.writeU32(loopEnd);
+    stream.writeU32(m_BlockCount);
+    stream.writeU32(m_WriteInfo.blockSizeBytes);
+    stream.writeU32(m_BlockSizeSamples);
+    stream.writeU32(m_LastBlockSizeBytes);
+    stream.writeU32(sampleCount - (m_BlockCount - 1) * m_BlockSizeSamples);
+    stream.writeU32(m_LastBlockSizeBytesRaw);
+    stream.writeU32(m_SeekSize != 0 ? 4 : 0);
+    stream.writeU32(m_BlockSizeSamples);
+    // sample data
+    stream.writeU16(0x1f00);
+    stream.writeU16(0);
+    stream.writeS32(sampleDataOffset);
+    stream.writeU16(regionInfoSize);
+    stream.writeU16(0);
+    // region info
+    stream.writeU16(0);
+    stream.writeU16(0);
+    stream.writeS32(m_RegionSize != 0 ? static_cast<int32_t>(sampleDataOffset) : -1);
+    stream.writeU32(loopStart);
+    stream.writeU32(loopEnd);
+    // checksum
+    stream.writeU32(0);
+}
+
+void BfstmWriter::writeTrackInfo(OutMemoryStream &stream) const {
+    const auto &trackInfos = m_WriteInfo.trackInfos;
+    stream.writeU32(trackInfos.size());
+    uint32_t offset = 4 + trackInfos.size() * 0x8;
+    for (const auto &track: trackInfos) {
+        stream.writeU16(0x4101);
+        stream.writeU16(0);
+        stream.writeS32(static_cast<int32_t>(offset));
+        offset += 0xC + align(4 + track.channelIndices.size(), 4);
+    }
+    for (const auto &track: trackInfos) {
+        stream.writeU8(track.volume);
+        stream.writeU8(track.pan);
+        stream.writeU8(track.span);
+        stream.writeU8(track.flags);
+        // The channel index table follows the track, relative to the track
+        stream.writeU16(0x0100);
+        stream.writeU16(0);
+        stream.writeS32(0xC);
+        stream.writeU32(track.channelIndices.size());
+        for (uint8_t index: track.channelIndices) {
+            stream.writeU8(index);
+        }
+        stream.fillToAlign(4);
+    }
+}
+
+void BfstmWriter::writeChannelInfo(OutMemoryStream &stream) const {
+    const uint32_t channelNum = m_WriteInfo.channelNum;
+    stream.writeU32(channelNum);
+    const uint32_t entriesStart = 4 + channelNum * 0x8;
+    for (uint32_t i = 0; i < channelNum; ++i) {
+        stream.writeU16(0x4102);
+        stream.writeU16(0);
+        stream.writeS32(static_cast<int32_t>(entriesStart + i * 0x8));
+    }
+
+    uint32_t adpcmInfoSize = 0;
+    uint16_t adpcmFlag = 0;
+    if (m_WriteInfo.encoding == SoundEncoding::DSP_ADPCM) {
+        adpcmInfoSize = dspAdpcmInfoSize;
+        adpcmFlag = 0x0300;
+    } else if (m_WriteInfo.encoding == SoundEncoding::IMA_ADPCM) {
+        adpcmInfoSize = imaAdpcmInfoSize;
+        adpcmFlag = 0x0301;
+    }
+    const uint32_t adpcmStart = entriesStart + channelNum * 0x8;
+    for (uint32_t i = 0; i < channelNum; ++i) {
+        stream.writeU16(adpcmFlag);
+        stream.writeU16(0);
+        // Relative to this entry
+        stream.writeS32(adpcmInfoSize == 0 ? -1
+                                           : static_cast<int32_t>(adpcmStart + i * adpcmInfoSize - entriesStart -
+                                                                  i * 0x8));
+    }
+
+    for (uint32_t i = 0; i < channelNum && adpcmInfoSize != 0; ++i) {
+        size_t start = stream.tell();
+        if (m_WriteInfo.encoding == SoundEncoding::DSP_ADPCM) {
+            const auto &dsp = get<BfstmDSPADPCMChannelInfo>(m_WriteInfo.channelInfos[i]);
+            for (const auto &coefficient: dsp.coefficients) {
+                stream.writeS16(coefficient[0]);
+                stream.writeS16(coefficient[1]);
+            }
+            for (const auto &context: {dsp.startContext, dsp.loopContext}) {
+                stream.writeU16(context.header);
+                stream.writeS16(context.yn1);
+                stream.writeS16(context.yn2);
+            }
+        } else {
+            const auto &ima = get<BfstmIMAADPCMChannelInfo>(m_WriteInfo.channelInfos[i]);
+            for (const auto &context: {ima.startContext, ima.loopContext}) {
+                stream.writeS16(context.predictor);
+                stream.writeU8(context.stepIndex);
+                stream.writeU8(0);
+            }
+        }
+        stream.writeNull(start + adpcmInfoSize - stream.tell());
+    }
+}
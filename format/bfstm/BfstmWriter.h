@@ -0,0 +1,102 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "BfstmFile.h"
+#include "../../codec/DspADPCM.h"
+#include "../../codec/EncodeMetrics.h"
+
+class OutMemoryStream;
+
+/**
+ * Writes a bfstm block by block. The layout of the whole file follows from the write info, so the sections before
+ * the sample data are written with placeholders first and rewritten by finish(). Only one block is held in memory
+ * (and the seek table with 4 bytes per block and channel).
+ */
+class BfstmWriter {
+public:
+    /**
+     * @param out Must be seekable, finish() rewrites the start of the file
+     */
+    BfstmWriter(std::ostream &out, BfstmWriteInfo writeInfo,
+                dspadpcm::EncodePreset preset = dspadpcm::EncodePreset::EXHAUSTIVE);
+
+    [[nodiscard]] uint32_t getBlockSizeSamples() const {
+        return m_BlockSizeSamples;
+    }
+
+    /**
+     * Encodes one block of planar pcm16 to the stream encoding. Every block but the last must have
+     * getBlockSizeSamples() samples. Ima-adpcm streams can only be written from encoded blocks.
+     */
+    bool writeBlock(const int16_t *const *channels, uint32_t sampleCount);
+
+    /**
+     * Writes one block that is already in the stream encoding, one buffer per channel.
+     * @param history The dsp-adpcm history before the block for every channel, nullptr for other encodings
+     */
+    bool writeEncodedBlock(const uint8_t *const *channels, uint32_t sampleCount, const BfstmHistoryInfo *history);
+
+    /**
+     * Replaces the dsp-adpcm start, loop and region contexts of a channel, for blocks that were encoded outside the
+     * writer (see encodeBfstmBlock). Must be called before finish().
+     * @param regionContexts One context per region
+     */
+    void setDspContexts(uint8_t channel, const DSPAdpcmContext &start, const DSPAdpcmContext &loop,
+                        std::span<const DSPAdpcmContext> regionContexts);
+
+    /**
+     * Rewrites the header, info, seek and region sections with the final contexts and the seek table.
+     * @return false if less samples than announced were written or the output failed
+     */
+    bool finish();
+
+    [[nodiscard]] const EncodeMetrics &getMetrics(uint8_t channel) const {
+        return m_Metrics[channel];
+    }
+
+    bool success = true;
+private:
+    uint32_t getBytesForSamples(uint32_t sampleCount) const;
+
+    uint32_t getTrackInfoSize() const;
+
+    bool checkBlock(uint32_t sampleCount);
+
+    void writeBlockData(const uint8_t *data, uint32_t bytes, uint32_t paddedBytes);
+
+    void writeLayout();
+
+    void writeInfoSection(OutMemoryStream &stream) const;
+
+    void writeStreamInfo(OutMemoryStream &stream) const;
+
+    void writeTrackInfo(OutMemoryStream &stream) const;
+
+    void writeChannelInfo(OutMemoryStream &stream) const;
+
+    std::ostream &m_Out;
+    BfstmWriteInfo m_WriteInfo;
+    dspadpcm::EncodePreset m_Preset;
+    uint32_t m_BlockSizeSamples = 0;
+    uint32_t m_BlockCount = 0;
+    uint32_t m_LastBlockSizeBytes = 0;
+    uint32_t m_LastBlockSizeBytesRaw = 0;
+    uint32_t m_HeaderSize = 0;
+    uint32_t m_InfoSize = 0;
+    uint32_t m_SeekOffset = 0, m_SeekSize = 0;
+    uint32_t m_RegionOffset = 0, m_RegionSize = 0;
+    uint32_t m_DataOffset = 0, m_DataSize = 0;
+    uint32_t m_NextBlock = 0;
+    std::vector<BfstmRegionInfo> m_Regions;
+    std::vector<BfstmHistoryInfo> m_SeekTable;
+    std::vector<std::array<int16_t, 2>> m_Yn;
+    std::vector<EncodeMetrics> m_Metrics;
+    std::vector<uint8_t> m_BlockBuffer;
+};
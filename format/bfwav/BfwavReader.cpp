@@ -67,7 +67,6 @@ std::optional<BfwavReadContext> BfwavReader::readInfo() {
     uint32_t size = m_Stream.readU32();
     BfwavReadContext context{};
     context.format = static_cast<SoundEncoding>(m_Stream.readU8());
-    std::cout << context.format << std::endl;
     bool isLoop = m_Stream.readU8();
     m_Stream.skip(2);
     context.sampleRate = m_Stream.readU32();
@@ -106,7 +105,8 @@ std::optional<BfwavReadContext> BfwavReader::readInfo() {
         }
         context.channelDataOffsets.emplace_back(dataRef.offset);
         auto dspAdpcmRef = readReferenceEntry(m_Stream);
-        if (dspAdpcmRef.flag != 0x0300) {
+        // Only dsp-adpcm channels reference a channel info
+        if (context.format == SoundEncoding::DSP_ADPCM && dspAdpcmRef.flag != 0x0300) {
             std::cerr << "Data Reference flag " << std::hex << dspAdpcmRef.flag << " unknown in FWAV info" << std::endl;
             return std::nullopt;
         }
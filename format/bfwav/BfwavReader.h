@@ -19,6 +19,18 @@ public:
     BfwavReadContext getContext() {
         return m_Context.value();
     }
+
+    /**
+     * @return Offset of the DATA section body, the channel data offsets are relative to it
+     */
+    [[nodiscard]] uint32_t getDataOffset() const {
+        return m_DataOffset;
+    }
+
+    // Pcm16 sample data has to be swapped if the file has the other byte order
+    [[nodiscard]] bool isByteOrderSwapped() const {
+        return m_Stream.swapBO;
+    }
 private:
     std::optional<BfwavReadContext> readHeader();
 
@@ -0,0 +1,21 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+struct WavLoop {
+    uint32_t startSample;
+    // Exclusive, the smpl chunk stores the last sample of the loop
+    uint32_t endSample;
+};
+
+struct WavInfo {
+    uint16_t channelNum;
+    uint32_t sampleRate;
+    uint32_t sampleCount;
+    std::optional<WavLoop> loop;
+};
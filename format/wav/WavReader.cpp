@@ -0,0 +1,137 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <bit>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "WavReader.h"
+#include "../../codec/SampleConvert.h"
+
+static uint16_t readLe16(const uint8_t *ptr) {
+    return ptr[0] | ptr[1] << 8;
+}
+
+static uint32_t readLe32(const uint8_t *ptr) {
+    return readLe16(ptr) | static_cast<uint32_t>(readLe16(ptr + 2)) << 16;
+}
+
+WavReader::WavReader(const std::filesystem::path &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Cannot open " << path << std::endl;
+        success = false;
+        return;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size > 0) {
+        void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            m_Map = static_cast<const uint8_t *>(map);
+            m_Size = size;
+            // The frames are read front to back once
+            madvise(map, m_Size, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+    if (!m_Map) {
+        std::cerr << "Cannot map " << path << std::endl;
+        success = false;
+        return;
+    }
+    success = parse();
+}
+
+WavReader::~WavReader() {
+    if (m_Map) {
+        munmap(const_cast<uint8_t *>(m_Map), m_Size);
+    }
+}
+
+bool WavReader::parse() {
+    if (m_Size < 12 || std::memcmp(m_Map, "RIFF", 4) != 0 || std::memcmp(m_Map + 8, "WAVE", 4) != 0) {
+        std::cerr << "File is no RIFF WAVE!" << std::endl;
+        return false;
+    }
+    bool hasFormat = false;
+    size_t offset = 12;
+    while (offset + 8 <= m_Size) {
+        const uint8_t *chunk = m_Map + offset;
+        uint32_t size = readLe32(chunk + 4);
+        const uint8_t *body = chunk + 8;
+        size_t available = std::min<size_t>(size, m_Size - offset - 8);
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && available >= 16) {
+            uint16_t format = readLe16(body);
+            // Extensible files store the format in the sub format guid
+            if (format == 0xFFFE && available >= 26) format = readLe16(body + 24);
+            uint16_t bitsPerSample = readLe16(body + 14);
+            if (format != 1 || bitsPerSample != 16) {
+                std::cerr << "Only pcm16 wav files are supported! (format " << format << ", " << bitsPerSample
+                          << " bit)" << std::endl;
+                return false;
+            }
+            m_Info.channelNum = readLe16(body + 2);
+            m_Info.sampleRate = readLe32(body + 4);
+            hasFormat = m_Info.channelNum != 0;
+        } else if (std::memcmp(chunk, "smpl", 4) == 0 && available >= 36 + 24 && readLe32(body + 28) > 0) {
+            // The loop end is inclusive
+            m_Info.loop = WavLoop{readLe32(body + 36 + 8), readLe32(body + 36 + 12) + 1};
+        } else if (std::memcmp(chunk, "data", 4) == 0) {
+            if (!hasFormat) {
+                std::cerr << "Wav data before format!" << std::endl;
+                return false;
+            }
+            if (offset % 2 != 0) {
+                std::cerr << "Wav data is not aligned!" << std::endl;
+                return false;
+            }
+            m_Frames = reinterpret_cast<const int16_t *>(body);
+            m_Info.sampleCount = available / (m_Info.channelNum * sizeof(int16_t));
+        }
+        // Chunks are padded to an even size
+        offset += 8 + static_cast<size_t>(size) + (size & 1);
+    }
+    if (!m_Frames) {
+        std::cerr << "Wav has no format or data chunk!" << std::endl;
+        return false;
+    }
+    if (m_Info.loop && (m_Info.loop->startSample >= m_Info.loop->endSample ||
+                        m_Info.loop->endSample > m_Info.sampleCount)) {
+        std::cerr << "Ignoring invalid wav loop " << m_Info.loop->startSample << " - " << m_Info.loop->endSample
+                  << std::endl;
+        m_Info.loop.reset();
+    }
+    return true;
+}
+
+void WavReader::readFrames(uint32_t start, uint32_t count, int16_t *const *channels) const {
+    sampleconv::deinterleaveS16(m_Frames + static_cast<size_t>(start) * m_Info.channelNum, channels,
+                                m_Info.channelNum, count);
+    if constexpr (std::endian::native == std::endian::big) {
+        for (uint32_t ch = 0; ch < m_Info.channelNum; ++ch) {
+            sampleconv::bswapS16(channels[ch], channels[ch], count);
+        }
+    }
+}
+
+void WavReader::readChannel(uint32_t channel, uint32_t start, uint32_t count, int16_t *dst) const {
+    const int16_t *src = m_Frames + static_cast<size_t>(start) * m_Info.channelNum + channel;
+    for (uint32_t i = 0; i < count; ++i) {
+        dst[i] = src[static_cast<size_t>(i) * m_Info.channelNum];
+    }
+    if constexpr (std::endian::native == std::endian::big) {
+        sampleconv::bswapS16(dst, dst, count);
+    }
+}
+
+void WavReader::release(uint32_t end) const {
+    auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t bytes = reinterpret_cast<const uint8_t *>(m_Frames + static_cast<size_t>(end) * m_Info.channelNum) - m_Map;
+    bytes = bytes / pageSize * pageSize;
+    if (bytes > 0) {
+        madvise(const_cast<uint8_t *>(m_Map), bytes, MADV_DONTNEED);
+    }
+}
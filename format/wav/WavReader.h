@@ -0,0 +1,52 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include "WavFile.h"
+
+/**
+ * Memory maps a pcm16 RIFF WAVE file. The samples are read straight from the mapping, so only the pages around the
+ * read frames are in memory. The first loop of a smpl chunk is read as the stream loop.
+ */
+class WavReader {
+public:
+    explicit WavReader(const std::filesystem::path &path);
+
+    ~WavReader();
+
+    WavReader(const WavReader &) = delete;
+
+    WavReader &operator=(const WavReader &) = delete;
+
+    [[nodiscard]] const WavInfo &getInfo() const {
+        return m_Info;
+    }
+
+    /**
+     * Deinterleaves the frames [start, start + count) to native order planar pcm16, one buffer per channel.
+     */
+    void readFrames(uint32_t start, uint32_t count, int16_t *const *channels) const;
+
+    /**
+     * Copies the samples [start, start + count) of one channel in native order.
+     */
+    void readChannel(uint32_t channel, uint32_t start, uint32_t count, int16_t *dst) const;
+
+    /**
+     * The frames before end are not read again, their pages may be dropped from memory.
+     */
+    void release(uint32_t end) const;
+
+    bool success = true;
+private:
+    bool parse();
+
+    const uint8_t *m_Map = nullptr;
+    size_t m_Size = 0;
+    const int16_t *m_Frames = nullptr;
+    WavInfo m_Info{};
+};
@@ -0,0 +1,109 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <bit>
+#include <iostream>
+#include <vector>
+#include "WavWriter.h"
+#include "../../MemoryResource.h"
+#include "../../codec/SampleConvert.h"
+
+// Frames that are interleaved and written at once
+static constexpr uint32_t CHUNK_FRAMES = 0x4000;
+static constexpr uint32_t FMT_SIZE = 16;
+// One sample loop
+static constexpr uint32_t SMPL_SIZE = 36 + 24;
+
+static uint32_t getHeaderSize(const WavInfo &info) {
+    uint32_t size = 12 + 8 + FMT_SIZE + 8;
+    if (info.loop) size += 8 + SMPL_SIZE;
+    return size;
+}
+
+uint64_t getWavFileSize(const WavInfo &info) {
+    return getHeaderSize(info) + static_cast<uint64_t>(info.sampleCount) * info.channelNum * sizeof(int16_t);
+}
+
+static void writeMagic(OutMemoryStream &stream, const char *magic) {
+    for (int i = 0; i < 4; ++i) {
+        stream.writeU8(magic[i]);
+    }
+}
+
+bool writeWav(std::ostream &out, const WavInfo &info, const int16_t *const *channels) {
+    uint64_t fileSize = getWavFileSize(info);
+    if (fileSize - 8 > 0xffffffff) {
+        std::cerr << "Wav file would be too large! " << fileSize << std::endl;
+        return false;
+    }
+    if (info.loop && (info.loop->startSample >= info.loop->endSample || info.loop->endSample > info.sampleCount)) {
+        std::cerr << "Wav loop " << info.loop->startSample << " - " << info.loop->endSample << " is invalid!"
+                  << std::endl;
+        return false;
+    }
+    uint32_t dataSize = fileSize - getHeaderSize(info);
+
+    MemoryResource resource{};
+    OutMemoryStream stream{resource};
+    stream.swapBO = std::endian::native == std::endian::big;
+    writeMagic(stream, "RIFF");
+    stream.writeU32(fileSize - 8);
+    writeMagic(stream, "WAVE");
+
+    writeMagic(stream, "fmt ");
+    stream.writeU32(FMT_SIZE);
+    // Integer pcm
+    stream.writeU16(1);
+    stream.writeU16(info.channelNum);
+    stream.writeU32(info.sampleRate);
+    stream.writeU32(info.sampleRate * info.channelNum * sizeof(int16_t));
+    stream.writeU16(info.channelNum * sizeof(int16_t));
+    stream.writeU16(16);
+
+    if (info.loop) {
+        writeMagic(stream, "smpl");
+        stream.writeU32(SMPL_SIZE);
+        // Manufacturer and product
+        stream.writeU32(0);
+        stream.writeU32(0);
+        // Sample period in nanoseconds
+        stream.writeU32(info.sampleRate == 0 ? 0 : 1000000000u / info.sampleRate);
+        // Unity note (middle c) and pitch fraction
+        stream.writeU32(60);
+        stream.writeU32(0);
+        // Smpte format and offset
+        stream.writeU32(0);
+        stream.writeU32(0);
+        stream.writeU32(1);
+        // Sampler data
+        stream.writeU32(0);
+        // Cue point id, type (forward loop), start, end (inclusive), fraction and play count (infinite)
+        stream.writeU32(0);
+        stream.writeU32(0);
+        stream.writeU32(info.loop->startSample);
+        stream.writeU32(info.loop->endSample - 1);
+        stream.writeU32(0);
+        stream.writeU32(0);
+    }
+
+    writeMagic(stream, "data");
+    stream.writeU32(dataSize);
+    out.write(static_cast<const char *>(resource.getAsPtrUnsafe(0)), static_cast<std::streamsize>(stream.tell()));
+
+    std::vector<int16_t> buffer(static_cast<size_t>(std::min(CHUNK_FRAMES, info.sampleCount)) * info.channelNum);
+    std::vector<const int16_t *> chunkChannels(info.channelNum);
+    for (uint32_t frame = 0; frame < info.sampleCount && out; frame += CHUNK_FRAMES) {
+        uint32_t frames = std::min(CHUNK_FRAMES, info.sampleCount - frame);
+        for (uint32_t ch = 0; ch < info.channelNum; ++ch) {
+            chunkChannels[ch] = channels[ch] + frame;
+        }
+        sampleconv::interleaveS16(chunkChannels.data(), buffer.data(), info.channelNum, frames);
+        if constexpr (std::endian::native == std::endian::big) {
+            sampleconv::bswapS16(buffer.data(), buffer.data(), frames * info.channelNum);
+        }
+        out.write(reinterpret_cast<const char *>(buffer.data()),
+                  static_cast<std::streamsize>(frames * info.channelNum * sizeof(int16_t)));
+    }
+    return static_cast<bool>(out);
+}
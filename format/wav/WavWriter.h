@@ -0,0 +1,21 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <ostream>
+#include "WavFile.h"
+
+/**
+ * @return The size of the wav file writeWav() writes for the info
+ */
+uint64_t getWavFileSize(const WavInfo &info);
+
+/**
+ * Writes a little endian pcm16 RIFF WAVE file. The loop is written as forward loop into a smpl chunk. The frames are
+ * interleaved chunk by chunk into one buffer, so there is one write per chunk and never a copy of the whole file.
+ * @param channels Planar pcm16, one buffer with info.sampleCount samples per channel
+ * @return false if the file would be larger than 4 GiB or the output failed
+ */
+bool writeWav(std::ostream &out, const WavInfo &info, const int16_t *const *channels);
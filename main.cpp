@@ -11,6 +11,7 @@
 #include "Window.h"
 #include "format/bfsar/BfsarReader.h"
 #include "format/bfstm/BfstmReader.h"
+#include "format/bfstm/BfstmEdit.h"
 #include "format/bfgrp/BfgrpReader.h"
 #include "format/bfgrp/BfgrpWriter.h"
 #include "format/bfwar/BfwarReader.h"
@@ -18,6 +19,11 @@
 #include "playback/DummyPlayback.h"
 #include "format/bfwav/BfwavReader.h"
 #include "format/bfsar/BfsarWriter.h"
+#include "codec/CodecBenchmark.h"
+#include "analysis/CoefficientAnalysis.h"
+#include "tools/WavExport.h"
+#include "tools/WavImport.h"
+#include "ThreadPool.h"
 
 snd_pcm_format_t getFormat(const SoundEncoding encoding) {
     switch (encoding) {
@@ -25,9 +31,9 @@ snd_pcm_format_t getFormat(const SoundEncoding encoding) {
             return SND_PCM_FORMAT_S8;
         case SoundEncoding::PCM16:
         case SoundEncoding::DSP_ADPCM:
-            return SND_PCM_FORMAT_S16_LE;
         case SoundEncoding::IMA_ADPCM:
-            return SND_PCM_FORMAT_IMA_ADPCM;
+            // Playback always delivers native order, big endian pcm16 files are swapped while playing
+            return SND_PCM_FORMAT_S16;
         default:
             return SND_PCM_FORMAT_UNKNOWN;
     }
@@ -104,6 +110,121 @@ void testOne() {
 }
 
 int main(int argc, char **argv) {
+    if (argc > 1 && std::string_view{argv[1]} == "bench") {
+        // bench [stream.bfstm [golden.pcm]]
+        return runCodecBenchmarks(std::cout, argc > 2 ? argv[2] : nullptr, argc > 3 ? argv[3] : nullptr) ? 0 : 1;
+    }
+    if (argc > 2 && std::string_view{argv[1]} == "analyze") {
+        // analyze <file.bfstm>, compares the stored dsp-adpcm coefficients with the ones the encoder calculates
+        std::ifstream in{argv[2], std::ios::binary};
+        if (!in) {
+            std::cerr << "Cannot open " << argv[2] << std::endl;
+            return 1;
+        }
+        MemoryResource resource{in};
+        BfstmReader reader{resource};
+        if (!reader.success) return 1;
+        const BfstmContext &context = reader.m_Context;
+        const void *dataPtr = resource.getAsPtrUnsafe(context.header.dataSection->offset + 0x8 +
+                                                      context.streamInfo.sampleDataOffset);
+        std::cout << "Analyzing the coefficients of " << static_cast<int>(context.streamInfo.channelNum)
+                  << " channels..." << std::endl;
+        auto analysis = analyzeCoefficientsAsync(context, dataPtr);
+        auto results = analysis.get();
+        for (const auto &fidelity: results) {
+            std::cout << fidelity;
+        }
+        return results.empty() ? 1 : 0;
+    }
+    if (argc > 3 && std::string_view{argv[1]} == "export") {
+        // export [--rate <hz>] [--start <sample>] [--downmix] <out dir> <bfstm, bfwav or directory>...
+        int first = 2;
+        WavExportSettings settings{};
+        // The options are followed by at least the out dir and one path
+        while (first + 2 < argc) {
+            std::string_view option{argv[first]};
+            if (option == "--downmix") {
+                settings.downmix = true;
+                ++first;
+            } else if (option == "--rate" && first + 3 < argc) {
+                settings.outputRate = std::stoul(argv[first + 1]);
+                first += 2;
+            } else if (option == "--start" && first + 3 < argc) {
+                settings.startSample = std::stoul(argv[first + 1]);
+                first += 2;
+            } else {
+                break;
+            }
+        }
+        std::vector<std::filesystem::path> paths{argv + first + 1, argv + argc};
+        auto files = collectWavExportFiles(paths);
+        ThreadPool pool{};
+        return exportWavs(std::cout, files, argv[first], pool, settings) ? 0 : 1;
+    }
+    if (argc > 3 && std::string_view{argv[1]} == "import") {
+        // import <in.wav> <out.bfstm> [fast|balanced|exhaustive|pcm16|pcm8]
+        WavImportSettings settings{};
+        std::string_view mode = argc > 4 ? argv[4] : "balanced";
+        if (mode == "fast") {
+            settings.preset = dspadpcm::EncodePreset::FAST;
+        } else if (mode == "exhaustive") {
+            settings.preset = dspadpcm::EncodePreset::EXHAUSTIVE;
+        } else if (mode == "pcm16") {
+            settings.encoding = SoundEncoding::PCM16;
+        } else if (mode == "pcm8") {
+            settings.encoding = SoundEncoding::PCM8;
+        } else if (mode != "balanced") {
+            std::cerr << "Unknown import mode " << mode << std::endl;
+            return 1;
+        }
+        return importWav(std::cout, argv[2], argv[3], settings) ? 0 : 1;
+    }
+    if (argc > 4 && std::string_view{argv[1]} == "reblock") {
+        // reblock <in.bfstm> <out.bfstm> <block size in bytes>
+        std::ifstream in{argv[2], std::ios::binary};
+        if (!in) {
+            std::cerr << "Cannot open " << argv[2] << std::endl;
+            return 1;
+        }
+        MemoryResource resource{in};
+        BfstmReader reader{resource};
+        if (!reader.success) return 1;
+        const BfstmContext &context = reader.m_Context;
+        const void *dataPtr = resource.getAsPtrUnsafe(context.header.dataSection->offset + 0x8 +
+                                                      context.streamInfo.sampleDataOffset);
+        std::ofstream out{argv[3], std::ios::binary};
+        ThreadPool pool{};
+        return reblockBfstm(out, context, dataPtr, std::stoul(argv[4], nullptr, 0), pool) ? 0 : 1;
+    }
+    if (argc > 3 && std::string_view{argv[1]} == "loop") {
+        // loop <file.bfstm> <start> <end> [align] or loop <file.bfstm> off, the file is patched in place
+        std::ifstream in{argv[2], std::ios::binary};
+        if (!in) {
+            std::cerr << "Cannot open " << argv[2] << std::endl;
+            return 1;
+        }
+        MemoryResource resource{in};
+        in.close();
+        BfstmReader reader{resource};
+        if (!reader.success) return 1;
+        BfstmContext &context = reader.m_Context;
+        const void *dataPtr = resource.getAsPtrUnsafe(context.header.dataSection->offset + 0x8 +
+                                                      context.streamInfo.sampleDataOffset);
+        BfstmLoopEdit loop{.isLoop = std::string_view{argv[3]} != "off"};
+        if (loop.isLoop) {
+            if (argc < 5) {
+                std::cerr << "Missing loop end!" << std::endl;
+                return 1;
+            }
+            loop.loopStart = std::stoul(argv[3], nullptr, 0);
+            loop.loopEnd = std::stoul(argv[4], nullptr, 0);
+            loop.alignToBlock = argc > 5 && std::string_view{argv[5]} == "align";
+        }
+        ThreadPool pool{};
+        if (!setBfstmLoop(context, dataPtr, loop, pool)) return 1;
+        std::fstream file{argv[2], std::ios::in | std::ios::out | std::ios::binary};
+        return patchBfstmLoop(file, context) ? 0 : 1;
+    }
     //iterateAll();
     testOne();
 
@@ -7,7 +7,7 @@
 #include "ALSAPlayback.h"
 
 ALSAPlayback::ALSAPlayback(const std::string &deviceName, const snd_pcm_format_t format, const unsigned int rate,
-                             const unsigned int channelCount) {
+                             const unsigned int channelCount, const bool interleaved) : m_Interleaved(interleaved) {
     if ((err = snd_pcm_open(&m_PlaybackHandle, deviceName.c_str(), SND_PCM_STREAM_PLAYBACK, 0)) < 0) {
         std::cout << "Cannot open audio device!\n" << snd_strerror(err) << std::endl;
         return;
@@ -20,8 +20,12 @@ ALSAPlayback::~ALSAPlayback() {
     snd_pcm_close(m_PlaybackHandle);
 }
 
-void ALSAPlayback::setHWParams(const snd_pcm_format_t format, unsigned int rate,
+void ALSAPlayback::setHWParams(snd_pcm_format_t format, unsigned int rate,
                                 const unsigned int channelCount) {
+    // play() converts pcm8 to pcm16 for interleaved devices
+    if (m_Interleaved) {
+        format = SND_PCM_FORMAT_S16;
+    }
     snd_pcm_hw_params_t *hw_params;
     if ((err = snd_pcm_hw_params_malloc(&hw_params))) {
         std::cout << "Cannot allocate hardware parameters!\n" << snd_strerror(err) << std::endl;
@@ -32,7 +36,9 @@ void ALSAPlayback::setHWParams(const snd_pcm_format_t format, unsigned int rate,
         snd_pcm_hw_params_free(hw_params);
         return;
     }
-    if ((err = snd_pcm_hw_params_set_access(m_PlaybackHandle, hw_params, SND_PCM_ACCESS_RW_NONINTERLEAVED)) < 0) {
+    if ((err = snd_pcm_hw_params_set_access(m_PlaybackHandle, hw_params,
+                                            m_Interleaved ? SND_PCM_ACCESS_RW_INTERLEAVED
+                                                          : SND_PCM_ACCESS_RW_NONINTERLEAVED)) < 0) {
         std::cout << "Cannot set access type!\n" << snd_strerror(err) << std::endl;
         snd_pcm_hw_params_free(hw_params);
         return;
@@ -42,6 +48,10 @@ void ALSAPlayback::setHWParams(const snd_pcm_format_t format, unsigned int rate,
         snd_pcm_hw_params_free(hw_params);
         return;
     }
+    // Pcm16 is resampled in process, so the device is opened at its native rate instead of the plug resampler
+    if (format != SND_PCM_FORMAT_S8 && (err = snd_pcm_hw_params_set_rate_resample(m_PlaybackHandle, hw_params, 0)) < 0) {
+        std::cout << "Cannot disable alsa resampling!\n" << snd_strerror(err) << std::endl;
+    }
     if ((err = snd_pcm_hw_params_set_rate_near(m_PlaybackHandle, hw_params, &rate, nullptr)) < 0) {
         std::cout << "Cannot set rate to " << rate << "!\n" << snd_strerror(err) << std::endl;
         snd_pcm_hw_params_free(hw_params);
@@ -58,6 +68,9 @@ void ALSAPlayback::setHWParams(const snd_pcm_format_t format, unsigned int rate,
         return;
     }
     snd_pcm_hw_params_free(hw_params);
+    if (format != SND_PCM_FORMAT_S8) {
+        m_DeviceRate = rate;
+    }
 }
 
 void ALSAPlayback::startDevice() const {
@@ -70,6 +83,12 @@ void ALSAPlayback::writeData(void **bufs, const size_t frames) const {
     }
 }
 
+void ALSAPlayback::writeInterleavedData(const int16_t *data, const size_t frames) const {
+    if (snd_pcm_writei(m_PlaybackHandle, data, frames) == -EPIPE) {
+        snd_pcm_prepare(m_PlaybackHandle);
+    }
+}
+
 std::vector<std::string> ALSAPlayback::getDevices() {
     char **hints = nullptr;
     snd_device_name_hint(-1, "pcm", reinterpret_cast<void ***>(&hints));
@@ -106,8 +125,13 @@ uint32_t ALSAPlayback::getDelayFrames() {
     return frames;
 }
 
-void ALSAPlayback::seek(const BfstmContext &context, const void *histPtr, uint32_t block) {
-    AudioPlayback::seek(context, histPtr, block);
+void ALSAPlayback::seek(const BfstmContext &context, uint32_t block) {
+    AudioPlayback::seek(context, block);
+    snd_pcm_prepare(m_PlaybackHandle);
+}
+
+void ALSAPlayback::seekSample(const BfstmContext &context, BfstmSeekIndex *index, uint32_t sample) {
+    AudioPlayback::seekSample(context, index, sample);
     snd_pcm_prepare(m_PlaybackHandle);
 }
 
@@ -14,8 +14,12 @@ extern "C" {
 
 class ALSAPlayback : public AudioPlayback {
 public:
+    /**
+     * @param interleaved Opens the device with interleaved access and pcm16 regardless of format, pcm8 streams are
+     * converted then.
+     */
     ALSAPlayback(const std::string &deviceName, snd_pcm_format_t format, unsigned int rate,
-                 unsigned int channelCount);
+                 unsigned int channelCount, bool interleaved = false);
 
     ~ALSAPlayback();
 
@@ -23,11 +27,23 @@ public:
 
     void writeData(void **bufs, size_t frames) const override;
 
+    [[nodiscard]] bool isInterleaved() const override {
+        return m_Interleaved;
+    }
+
+    void writeInterleavedData(const int16_t *data, size_t frames) const override;
+
+    [[nodiscard]] uint32_t getDeviceRate() const override {
+        return m_DeviceRate;
+    }
+
     void stop() override;
 
     void pause(bool enable) override;
 
-    void seek(const BfstmContext &context, const void *histPtr, uint32_t block) override;
+    void seek(const BfstmContext &context, uint32_t block) override;
+
+    void seekSample(const BfstmContext &context, BfstmSeekIndex *index, uint32_t sample) override;
 
     void join() override;
 
@@ -40,6 +56,8 @@ private:
     void setHWParams(snd_pcm_format_t format, unsigned int rate, unsigned int channelCount);
 
     snd_pcm_t *m_PlaybackHandle{};
+    bool m_Interleaved;
+    uint32_t m_DeviceRate = 0;
     int err;
 };
 
@@ -1,8 +1,16 @@
 //
 // Created by cookieso on 01.08.24.
 //
+#include <algorithm>
 #include "AudioPlayback.h"
 #include "PlaybackFunctions.h"
+#include "../format/bfstm/BfstmBlocks.h"
+#include "../format/bfstm/BfstmDecoder.h"
+#include "../format/bfstm/BfstmSeekIndex.h"
+#include "../codec/SampleConvert.h"
+#include "../codec/Resampler.h"
+#include "RegionSchedule.h"
+#include "TrackMixer.h"
 
 void AudioPlayback::play(const BfstmContext &context, const void *dataPtr) {
     if (context.streamInfo.isLoop) {
@@ -25,109 +33,303 @@ void AudioPlayback::play(const BfstmContext &context, const void *dataPtr) {
         m_Coefficients = std::make_unique_for_overwrite<int16_t[][8][2]>(context.streamInfo.channelNum);
         m_Yn = std::make_unique_for_overwrite<int16_t[][2]>(context.streamInfo.channelNum);
         initDsp(context, m_Coefficients, m_Yn);
+        std::lock_guard<std::mutex> guard{m_WriteAudio};
+        m_SeekIndex = std::make_shared<BfstmSeekIndex>(context, dataPtr);
+    } else if (context.streamInfo.soundEncoding == SoundEncoding::IMA_ADPCM) {
+        m_ImaContext = std::make_unique_for_overwrite<IMAAdpcmContext[]>(context.streamInfo.channelNum);
+        initIma(context, m_ImaContext);
     }
+    m_DataPtr = dataPtr;
 
-    if (!context.regionInfos.empty()) {
-        incRegion();
-        m_RegEndSample = context.regionInfos[0].first.endSample - 1;
+    uint32_t sampleSize = context.streamInfo.soundEncoding == SoundEncoding::PCM16 ? 2 : 1;
+    uint32_t maxChannels = context.streamInfo.channelNum < 2 ? 1 : 2;
+    bool isPcm8 = context.streamInfo.soundEncoding == SoundEncoding::PCM8;
+    // The mixer decodes every channel and mixes the tracks down to the two output channels
+    bool mixTracks = m_Mixer && context.streamInfo.channelNum >= 2;
+    if (mixTracks && isPcm8) {
+        std::cerr << "Cannot mix the tracks of a pcm8 stream!" << std::endl;
+        mixTracks = false;
+    }
+    uint32_t decodeChannels = mixTracks ? context.streamInfo.channelNum : maxChannels;
+
+    uint32_t outputRate = context.streamInfo.sampleRate;
+    // Interleaved devices always take pcm16, pcm8 is converted before resampling
+    bool convertPcm8 = isPcm8 && isInterleaved();
+    std::unique_ptr<Resampler> resampler;
+    if (uint32_t deviceRate = getDeviceRate(); deviceRate != 0 && deviceRate != outputRate) {
+        if (isPcm8 && !convertPcm8) {
+            std::cerr << "Cannot resample pcm8 to the device rate " << deviceRate << "!" << std::endl;
+        } else {
+            resampler = std::make_unique<Resampler>(outputRate, deviceRate, maxChannels);
+            outputRate = deviceRate;
+        }
     }
 
-    auto writeFun = [this](void **data, uint32_t frames) {
-        writeData(data, frames);
+    auto outputFun = [this, maxChannels](void **data, uint32_t frames) {
+        if (!isInterleaved()) {
+            writeData(data, frames);
+            return;
+        }
+        std::array<const int16_t *, 2> channels{};
+        for (uint32_t i = 0; i < maxChannels; ++i) {
+            channels[i] = static_cast<const int16_t *>(data[i]);
+        }
+        m_InterleaveBuffer.resize(frames * maxChannels);
+        sampleconv::interleaveS16(channels.data(), m_InterleaveBuffer.data(), maxChannels, frames);
+        writeInterleavedData(m_InterleaveBuffer.data(), frames);
     };
 
-    uint32_t sampleSize = context.streamInfo.soundEncoding == SoundEncoding::PCM16 ? 2 : 1;
-    uint32_t maxChannels = context.streamInfo.channelNum < 2 ? 1 : 2;
+    auto writeFun = [this, maxChannels, convertPcm8, &resampler, &outputFun](void **data, uint32_t frames) {
+        std::array<int16_t *, 2> converted{};
+        if (convertPcm8) {
+            m_ConvertBuffer.resize(frames * maxChannels);
+            for (uint32_t i = 0; i < maxChannels; ++i) {
+                converted[i] = m_ConvertBuffer.data() + i * frames;
+                sampleconv::s8ToS16(static_cast<const int8_t *>(data[i]), converted[i], frames);
+            }
+            data = reinterpret_cast<void **>(converted.data());
+        }
+        if (!resampler) {
+            outputFun(data, frames);
+            return;
+        }
+        size_t maxFrames = resampler->getMaxOutputFrames(frames);
+        m_ResampleBuffer.resize(maxFrames * maxChannels);
+        std::array<int16_t *, 2> channels{};
+        for (uint32_t i = 0; i < maxChannels; ++i) {
+            channels[i] = m_ResampleBuffer.data() + i * maxFrames;
+        }
+        size_t produced = resampler->process(reinterpret_cast<const int16_t *const *>(data), frames, channels.data());
+        outputFun(reinterpret_cast<void **>(channels.data()), produced);
+    };
+
+    // The filter holds back the last frames of the stream
+    auto flushFun = [this, maxChannels, &resampler, &outputFun]() {
+        if (!resampler) return;
+        size_t maxFrames = resampler->getMaxOutputFrames(0);
+        m_ResampleBuffer.resize(maxFrames * maxChannels);
+        std::array<int16_t *, 2> channels{};
+        for (uint32_t i = 0; i < maxChannels; ++i) {
+            channels[i] = m_ResampleBuffer.data() + i * maxFrames;
+        }
+        size_t produced = resampler->flush(channels.data());
+        outputFun(reinterpret_cast<void **>(channels.data()), produced);
+    };
+
+    auto mixFun = [this, &writeFun](void **data, uint32_t frames) {
+        m_MixBuffer.resize(frames * 2);
+        std::array<int16_t *, 2> stereo{m_MixBuffer.data(), m_MixBuffer.data() + frames};
+        m_Mixer->mix(reinterpret_cast<const int16_t *const *>(data), stereo.data(), frames);
+        writeFun(reinterpret_cast<void **>(stereo.data()), frames);
+    };
+    std::function<void(void **, uint32_t)> decodedFun = writeFun;
+    if (mixTracks) decodedFun = mixFun;
 
+    // Native order pcm16 is passed straight from the file, the other byte order is swapped into a reusable buffer
+    bool swapBytes = context.streamInfo.soundEncoding == SoundEncoding::PCM16 && context.header.isByteOrderSwapped();
+    m_SwapChannels.resize(swapBytes ? decodeChannels : 0);
+    auto simpleWriteFun = [this, decodeChannels, swapBytes, &decodedFun](void **data, uint32_t frames) {
+        if (!swapBytes) {
+            decodedFun(data, frames);
+            return;
+        }
+        m_SwapBuffer.resize(frames * decodeChannels);
+        for (uint32_t i = 0; i < decodeChannels; ++i) {
+            sampleconv::bswapS16(static_cast<const int16_t *>(data[i]), m_SwapBuffer.data() + i * frames, frames);
+            m_SwapChannels[i] = m_SwapBuffer.data() + i * frames;
+        }
+        decodedFun(m_SwapChannels.data(), frames);
+    };
+
+    BfstmBlockRange blocks{context, dataPtr};
+    std::vector<const uint8_t *> mixChannels(mixTracks ? decodeChannels : 0);
+    // Region playback only walks the precompiled steps, other threads choose the next region through m_RegionIdx
+    std::optional<RegionSchedule> schedule;
+    uint32_t region = 0;
+    uint32_t step = 0;
+    // Only the audio thread moves the position, seeks hand their position over through m_NextBlock
+    uint32_t nextBlock = 0;
+    if (!context.regionInfos.empty()) {
+        schedule.emplace(context, dataPtr);
+        if (schedule->success) {
+            m_RegionIdx = 0;
+            nextBlock = schedule->getSteps(0)[0].block;
+        } else {
+            schedule.reset();
+        }
+    }
     while (true) {
         m_Paused.wait(true);
         if (m_ShouldStop) break;
-        m_WriteAudio.lock();
-        uint32_t i = m_NextBlock;
-        bool isLast = i + 1 == context.streamInfo.blockCountPerChannel;
-        uint32_t off = i * context.streamInfo.channelNum * context.streamInfo.blockSizeBytes;
-        uint32_t frameCount = isLast ? context.streamInfo.lastBlockSizeSamples
-                                     : context.streamInfo.blockSizeSamples;
-        uint32_t thisBlockSize = isLast ? context.streamInfo.lastBlockSizeBytesRaw
-                                        : context.streamInfo.blockSizeBytes;
-        uint32_t startSample = i * context.streamInfo.blockSizeSamples;
-        uint32_t endSample = startSample + frameCount;
         uint32_t startSampleInBlock = 0;
-        if (m_RegionIdx != -1 && startSample <= m_RegStartSample && endSample >= m_RegStartSample) {
-            startSampleInBlock = m_RegStartSample - startSample;
+        bool seeked = m_Seeked;
+        if (seeked) {
+            // The seek methods prepared the history of the new position, it replaces the current one
+            std::lock_guard<std::mutex> guard{m_WriteAudio};
+            m_Seeked = false;
+            nextBlock = m_NextBlock;
+            startSampleInBlock = m_SeekSampleInBlock;
             if (context.streamInfo.soundEncoding == SoundEncoding::DSP_ADPCM) {
-                m_WriteAudio.unlock();
-                initRegionDspYn(context, m_RegionIdx, m_Yn);
-                m_WriteAudio.lock();
+                std::copy_n(m_SeekYn[0], context.streamInfo.channelNum * 2, m_Yn[0]);
+            } else if (context.streamInfo.soundEncoding == SoundEncoding::IMA_ADPCM) {
+                std::copy_n(m_SeekIma.get(), context.streamInfo.channelNum, m_ImaContext.get());
             }
         }
-
-        bool isRegionEnd = false;
-        if (m_RegionIdx != -1 && startSample <= m_RegEndSample && endSample >= m_RegEndSample) {
-            frameCount = m_RegEndSample - startSample + 1;
-            isRegionEnd = true;
+        // The filter history belongs to the old position
+        if (seeked && resampler) resampler->reset();
+        const RegionStep *regionStep = nullptr;
+        if (schedule) {
+            if (seeked) {
+                // Stay in the current region if it contains the seek position
+                uint32_t found = schedule->findStep(region, nextBlock, startSampleInBlock);
+                for (uint32_t r = 0; found == RegionSchedule::npos && r < schedule->getRegionCount(); ++r) {
+                    found = schedule->findStep(r, nextBlock, startSampleInBlock);
+                    if (found != RegionSchedule::npos) region = r;
+                }
+                if (found == RegionSchedule::npos) {
+                    std::cerr << "Seek position is in no region!" << std::endl;
+                    seeked = false;
+                    step = 0;
+                } else {
+                    step = found;
+                }
+            }
+            regionStep = &schedule->getSteps(region)[step];
+            if (!seeked || startSampleInBlock < regionStep->startSampleInBlock) {
+                startSampleInBlock = regionStep->startSampleInBlock;
+                if (regionStep->reloadContext) {
+                    if (context.streamInfo.soundEncoding == SoundEncoding::DSP_ADPCM) {
+                        initRegionDspYn(context, region, m_Yn);
+                    } else if (context.streamInfo.soundEncoding == SoundEncoding::IMA_ADPCM) {
+                        std::ranges::copy(schedule->getImaContexts(region), m_ImaContext.get());
+                    }
+                }
+            }
         }
-        frameCount -= startSampleInBlock;
+        const BfstmBlock block = blocks[regionStep ? regionStep->block : nextBlock];
+        uint32_t frameCount = regionStep ? regionStep->startSampleInBlock + regionStep->frameCount - startSampleInBlock
+                                         : block.sampleCount - startSampleInBlock;
+        uint32_t thisBlockSize = block.channelStride;
+
+        uint32_t startChannel = mixTracks ? 0 : m_ChannelIndex.load();
 
-        //std::cout << m_NextBlock << ": Start sample: " << startSampleInBlock << " End Sample: " << frameCount - 1 + startSampleInBlock << std::endl;
+        //std::cout << nextBlock << ": Start sample: " << startSampleInBlock << " End Sample: " << frameCount - 1 + startSampleInBlock << std::endl;
 
-        if (context.streamInfo.soundEncoding == SoundEncoding::DSP_ADPCM) {
-            decodeFrameBlockDSP(maxChannels, m_ChannelIndex, frameCount, startSampleInBlock, thisBlockSize,
-                                reinterpret_cast<const void *>(reinterpret_cast<size_t>(dataPtr) + off),
-                                m_Coefficients, m_Yn,
-                                writeFun);
+        if (mixTracks && context.streamInfo.soundEncoding == SoundEncoding::DSP_ADPCM) {
+            // The mixer decodes the channels straight into its mix
+            for (uint32_t ch = 0; ch < decodeChannels; ++ch) {
+                mixChannels[ch] = block.getChannelPtr(ch);
+            }
+            m_MixBuffer.resize(frameCount * 2);
+            std::array<int16_t *, 2> stereo{m_MixBuffer.data(), m_MixBuffer.data() + frameCount};
+            m_Mixer->mixDsp(mixChannels.data(), m_Coefficients.get(), m_Yn.get(), startSampleInBlock, stereo.data(),
+                            frameCount);
+            writeFun(reinterpret_cast<void **>(stereo.data()), frameCount);
+        } else if (context.streamInfo.soundEncoding == SoundEncoding::DSP_ADPCM) {
+            decodeFrameBlockDSP(decodeChannels, startChannel, frameCount, startSampleInBlock, thisBlockSize,
+                                block.data, m_Coefficients, m_Yn,
+                                decodedFun);
+        } else if (context.streamInfo.soundEncoding == SoundEncoding::IMA_ADPCM) {
+            decodeFrameBlockIMA(decodeChannels, startChannel, frameCount, startSampleInBlock, thisBlockSize,
+                                block.data, m_ImaContext, decodedFun);
         } else {
-            decodeFrameBlockSimple(maxChannels, m_ChannelIndex, frameCount, startSampleInBlock / sampleSize,
-                                   thisBlockSize,
-                                   reinterpret_cast<const void *>(reinterpret_cast<size_t>(dataPtr) + off),
-                                   writeFun);
-        }
-
-        ++m_NextBlock;
-        if (isRegionEnd) {
-            const auto &reg = context.regionInfos[m_RegionIdx].first;
-            uint32_t predicted = m_NextBlock;
-            m_NextBlock = reg.startSample / context.streamInfo.blockSizeSamples;
-            if (m_NextBlock >= predicted || (m_NextBlock == predicted - 1 && frameCount != context.streamInfo.blockSizeSamples)) {
-                m_RegStartSample = reg.startSample;
-                m_RegEndSample = reg.endSample - 1;
+            decodeFrameBlockSimple(decodeChannels, startChannel, frameCount, startSampleInBlock * sampleSize,
+                                   thisBlockSize, block.data, simpleWriteFun);
+        }
+
+        if (regionStep) {
+            if (regionStep->isRegionEnd) {
+                region = m_RegionIdx % schedule->getRegionCount();
+                step = 0;
+            } else {
+                ++step;
             }
-            m_WriteAudio.unlock();
-            initRegionDspYn(context, m_RegionIdx, m_Yn);
-        } else if (m_NextBlock == context.streamInfo.blockCountPerChannel) {
-            m_WriteAudio.unlock();
+            nextBlock = schedule->getSteps(region)[step].block;
+        } else if (++nextBlock == context.streamInfo.blockCountPerChannel) {
             if (context.streamInfo.isLoop) {
-                prepareLoop(context);
+                nextBlock = prepareLoop(context);
             } else {
                 m_ShouldStop = true;
+                flushFun();
             }
-        } else {
-            m_WriteAudio.unlock();
         }
 
-        double storedFrames = static_cast<int32_t>(getDelayFrames()) - static_cast<int32_t>(context.streamInfo.blockSizeSamples);
+        double storedFrames = static_cast<int32_t>(getDelayFrames()) -
+                              static_cast<double>(context.streamInfo.blockSizeSamples) * outputRate /
+                              context.streamInfo.sampleRate;
         if (storedFrames >= 0) {
-            std::this_thread::sleep_for(std::chrono::duration<double>((storedFrames) / context.streamInfo.sampleRate));
+            std::this_thread::sleep_for(std::chrono::duration<double>((storedFrames) / outputRate));
         }
     }
     join();
+    {
+        std::lock_guard<std::mutex> guard{m_WriteAudio};
+        m_SeekIndex.reset();
+    }
     std::cout << "Audio playback finished." << std::endl;
 }
 
-void AudioPlayback::prepareLoop(const BfstmContext &context) {
+uint32_t AudioPlayback::prepareLoop(const BfstmContext &context) {
+    if (context.streamInfo.soundEncoding == SoundEncoding::DSP_ADPCM) {
+        initLoopDspYn(context, m_Yn);
+    } else if (context.streamInfo.soundEncoding == SoundEncoding::IMA_ADPCM) {
+        initLoopIma(context, m_ImaContext);
+    }
+    return context.streamInfo.loopStart / context.streamInfo.blockSizeSamples;
+}
+
+void AudioPlayback::seek(const BfstmContext &context, uint32_t block) {
     std::lock_guard<std::mutex> guard{m_WriteAudio};
-    m_NextBlock = context.streamInfo.loopStart / context.streamInfo.blockSizeSamples;
-    initLoopDspYn(context, m_Yn);
+    if (block >= context.streamInfo.blockCountPerChannel) {
+        std::cerr << "Cannot seek to block " << block << ", the stream has "
+                  << context.streamInfo.blockCountPerChannel << " blocks" << std::endl;
+        return;
+    }
+    if (context.streamInfo.soundEncoding == SoundEncoding::DSP_ADPCM) {
+        // A failed seek keeps a pending one intact
+        std::shared_ptr<int16_t[][2]> yn = std::make_unique_for_overwrite<int16_t[][2]>(context.streamInfo.channelNum);
+        // Without seek table the index walks the stream to the block
+        if (!initDspYn(context, block, yn) &&
+            !(m_SeekIndex && m_SeekIndex->getDspYn(block * context.streamInfo.blockSizeSamples, yn))) {
+            return;
+        }
+        m_SeekYn = std::move(yn);
+    } else if (context.streamInfo.soundEncoding == SoundEncoding::IMA_ADPCM) {
+        m_SeekIma = std::make_unique_for_overwrite<IMAAdpcmContext[]>(context.streamInfo.channelNum);
+        initImaAt(context, m_DataPtr, block, m_SeekIma);
+    }
+    m_NextBlock = block;
+    m_SeekSampleInBlock = 0;
+    m_Seeked = true;
 }
 
-void AudioPlayback::seek(const BfstmContext &context, const void *histPtr, uint32_t block) {
+void AudioPlayback::seekSample(const BfstmContext &context, BfstmSeekIndex *index, uint32_t sample) {
     std::lock_guard<std::mutex> guard{m_WriteAudio};
+    uint32_t block = sample / context.streamInfo.blockSizeSamples;
+    uint32_t sampleInBlock = sample % context.streamInfo.blockSizeSamples;
+    if (sample >= getStreamSampleCount(context.streamInfo)) {
+        std::cerr << "Cannot seek to sample " << sample << ", it is after the stream end" << std::endl;
+        return;
+    }
+    if (context.streamInfo.soundEncoding == SoundEncoding::DSP_ADPCM) {
+        std::shared_ptr<int16_t[][2]> yn = std::make_unique_for_overwrite<int16_t[][2]>(context.streamInfo.channelNum);
+        if (!index) index = m_SeekIndex.get();
+        if (!index || !index->getDspYn(sample, yn)) {
+            std::cerr << "No seek index, seeking to the start of block " << block << std::endl;
+            if (!initDspYn(context, block, yn)) return;
+            sampleInBlock = 0;
+        }
+        m_SeekYn = std::move(yn);
+    } else if (context.streamInfo.soundEncoding == SoundEncoding::IMA_ADPCM) {
+        m_SeekIma = std::make_unique_for_overwrite<IMAAdpcmContext[]>(context.streamInfo.channelNum);
+        initImaAt(context, m_DataPtr, block, m_SeekIma);
+    }
     m_NextBlock = block;
-    initDspYn(context, histPtr, block, m_Yn);
+    m_SeekSampleInBlock = sampleInBlock;
+    m_Seeked = true;
 }
 
 void AudioPlayback::incRegion() {
-    std::lock_guard<std::mutex> guard{m_WriteAudio};
     ++m_RegionIdx;
 }
 
@@ -9,6 +9,9 @@
 #include <condition_variable>
 #include "../format/bfstm/BfstmFile.h"
 
+class BfstmSeekIndex;
+class TrackMixer;
+
 /**
  * This class is thread safe! It is recommended to call play() on a different thread.
  */
@@ -18,6 +21,25 @@ public:
 
     virtual void writeData(void **bufs, size_t frames) const = 0;
 
+    /**
+     * Backends that need interleaved frames return true here and get their data through writeInterleavedData().
+     */
+    [[nodiscard]] virtual bool isInterleaved() const {
+        return false;
+    }
+
+    /**
+     * @return The sample rate the device plays at or 0 if it accepts the stream rate. Pcm16 output is resampled to it.
+     */
+    [[nodiscard]] virtual uint32_t getDeviceRate() const {
+        return 0;
+    }
+
+    /**
+     * Only called if isInterleaved() returns true. The frames are always pcm16, pcm8 streams are converted.
+     */
+    virtual void writeInterleavedData(const int16_t *data, size_t frames) const {}
+
     /**
      * This method plays audio until stop() is called or until the audio playback is done (if it doesn't prepareLoop).
      * @param context
@@ -25,10 +47,20 @@ public:
      */
     void play(const BfstmContext &context, const void *resource);
 
-    virtual void seek(const BfstmContext &context, const void *histPtr, uint32_t block);
+    /**
+     * Dsp-adpcm streams need the seek table of the context.
+     */
+    virtual void seek(const BfstmContext &context, uint32_t block);
+
+    /**
+     * Seeks to any sample. Dsp-adpcm streams use the index or, if it is nullptr, the one play() builds. Without a
+     * usable index the playback seeks to the start of the block that contains sample.
+     */
+    virtual void seekSample(const BfstmContext &context, BfstmSeekIndex *index, uint32_t sample);
 
     /**
-     * Important! No check if this track has regions!
+     * Plays the next region once the current one ends, after the last region the first one follows. Doesn't lock,
+     * the audio thread picks the region up at the end of the current one.
      */
     void incRegion();
 
@@ -40,6 +72,14 @@ public:
         m_ChannelIndex = channelIndex;
     }
 
+    /**
+     * Mixes all tracks of the stream to stereo instead of playing the channel pair chosen with setChannel().
+     * Must be set before play(), nullptr disables the mixer.
+     */
+    void setTrackMixer(std::shared_ptr<TrackMixer> mixer) {
+        m_Mixer = std::move(mixer);
+    }
+
     virtual void stop() {
         m_ShouldStop = true;
         m_Paused = false;
@@ -68,14 +108,36 @@ protected:
     std::atomic_bool m_ShouldStop = false;
     std::atomic_bool m_Paused = false;
 private:
-    void prepareLoop(const BfstmContext &context);
+    /**
+     * Loads the loop start history. Only call this from the audio thread!
+     * @return The block the loop starts at
+     */
+    uint32_t prepareLoop(const BfstmContext &context);
 
     std::shared_ptr<int16_t[][8][2]> m_Coefficients;
     std::shared_ptr<int16_t[][2]> m_Yn;
+    std::shared_ptr<IMAAdpcmContext[]> m_ImaContext;
+    // The history at the seek position, the audio thread takes it over with the position once m_Seeked is set
+    std::shared_ptr<int16_t[][2]> m_SeekYn;
+    std::shared_ptr<IMAAdpcmContext[]> m_SeekIma;
+    const void *m_DataPtr = nullptr;
+    std::vector<int16_t> m_InterleaveBuffer;
+    std::vector<int16_t> m_ConvertBuffer;
+    std::vector<int16_t> m_ResampleBuffer;
+    std::vector<int16_t> m_SwapBuffer;
+    // One pointer per decoded channel into m_SwapBuffer
+    std::vector<void *> m_SwapChannels;
+    std::vector<int16_t> m_MixBuffer;
+    std::shared_ptr<TrackMixer> m_Mixer;
+    // Built lazily for dsp-adpcm streams while playing, guarded by m_WriteAudio
+    std::shared_ptr<BfstmSeekIndex> m_SeekIndex;
+    // Guards the seek position and history, the audio thread only locks it to take over a seek
     std::mutex m_WriteAudio;
+    // The block the playback continues at after a seek
     std::atomic_uint32_t m_NextBlock = 0;
-    std::atomic_uint32_t m_RegionIdx = -1;
-    std::atomic_uint32_t m_RegStartSample;
-    std::atomic_uint32_t m_RegEndSample;
+    std::atomic_uint32_t m_SeekSampleInBlock = 0;
+    std::atomic_uint32_t m_RegionIdx = 0;
+    // Set by the seek methods, region playback looks up the step of the new position then
+    std::atomic_bool m_Seeked = false;
     std::atomic_uint32_t m_ChannelIndex = 0;
 };
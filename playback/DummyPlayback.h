@@ -13,7 +13,9 @@ public:
 
     void writeData(void **bufs, size_t frames) const override {}
 
-    void seek(const BfstmContext &context, const void *histPtr, uint32_t block) override {}
+    void seek(const BfstmContext &context, uint32_t block) override {}
+
+    void seekSample(const BfstmContext &context, BfstmSeekIndex *index, uint32_t sample) override {}
 
     void stop() override {
         AudioPlayback::stop();
@@ -5,8 +5,10 @@
 #include <memory>
 #include <functional>
 #include <iostream>
+#include "../format/bfstm/BfstmBlocks.h"
 #include "../format/bfstm/BfstmFile.h"
 #include "../codec/DspADPCM.h"
+#include "../codec/ImaADPCM.h"
 
 void initLoopDspYn(const BfstmContext &context, std::shared_ptr<int16_t[][2]> &dspYn) {
     for (int i = 0; i < context.streamInfo.channelNum; ++i) {
@@ -16,15 +18,23 @@ void initLoopDspYn(const BfstmContext &context, std::shared_ptr<int16_t[][2]> &d
     }
 }
 
-void
-initDspYn(const BfstmContext &context, const void *histPtr, uint32_t blockIndex, std::shared_ptr<int16_t[][2]> &dspYn) {
-    auto histInfo = static_cast<const BfstmHistoryInfo *>(histPtr);
-    // TODO Check channel seek info size
+bool initDspYn(const BfstmContext &context, uint32_t blockIndex, std::shared_ptr<int16_t[][2]> &dspYn) {
+    if (context.seekTable.empty()) {
+        std::cerr << "Stream has no seek table, cannot seek to block " << blockIndex << std::endl;
+        return false;
+    }
+    if (blockIndex >= context.streamInfo.blockCountPerChannel) {
+        std::cerr << "Cannot seek to block " << blockIndex << ", the stream has "
+                  << context.streamInfo.blockCountPerChannel << " blocks" << std::endl;
+        return false;
+    }
+    const BfstmHistoryInfo *histInfo = &context.seekTable[blockIndex * context.streamInfo.channelNum];
     for (int i = 0; i < context.streamInfo.channelNum; ++i) {
-        auto yn = histInfo[blockIndex * context.streamInfo.channelNum + i];
+        auto yn = histInfo[i];
         dspYn[i][0] = yn.histSample1;
         dspYn[i][1] = yn.histSample2;
     }
+    return true;
 }
 
 void initRegionDspYn(const BfstmContext &context, uint32_t regionIndex, std::shared_ptr<int16_t[][2]> &dspYn) {
@@ -48,6 +58,36 @@ void initDsp(const BfstmContext &context, std::shared_ptr<int16_t[][8][2]> &coef
     }
 }
 
+void initIma(const BfstmContext &context, std::shared_ptr<IMAAdpcmContext[]> &imaContext) {
+    for (int i = 0; i < context.streamInfo.channelNum; ++i) {
+        imaContext[i] = get<BfstmIMAADPCMChannelInfo>(context.channelInfos[i]).startContext;
+    }
+}
+
+void initLoopIma(const BfstmContext &context, std::shared_ptr<IMAAdpcmContext[]> &imaContext) {
+    for (int i = 0; i < context.streamInfo.channelNum; ++i) {
+        imaContext[i] = get<BfstmIMAADPCMChannelInfo>(context.channelInfos[i]).loopContext;
+    }
+}
+
+/**
+ * Ima-adpcm streams have no seek history, so the state is restored by decoding all blocks before blockIndex.
+ */
+void initImaAt(const BfstmContext &context, const void *dataPtr, uint32_t blockIndex,
+               std::shared_ptr<IMAAdpcmContext[]> &imaContext) {
+    const auto &streamInfo = context.streamInfo;
+    initIma(context, imaContext);
+    auto scratch = std::make_unique_for_overwrite<int16_t[]>(streamInfo.blockSizeSamples);
+    BfstmBlockRange blocks{context, dataPtr};
+    for (const BfstmBlock block: blocks) {
+        if (block.index >= blockIndex || block.isLast) break;
+        for (int i = 0; i < streamInfo.channelNum; ++i) {
+            imaadpcm::decode(block.getChannelPtr(i), scratch.get(), imaContext[i].predictor,
+                             imaContext[i].stepIndex, block.sampleCount, 0);
+        }
+    }
+}
+
 /**
  *
  * @param channelNum Number of played channels
@@ -97,18 +137,48 @@ int decodeFrameBlockDSP(uint32_t channelNum, uint32_t startChannel, uint32_t fra
         auto *start = reinterpret_cast<uint8_t *>(reinterpret_cast<size_t>(offsetDataPtr) + j * thisBlockSizeRaw);
         dspadpcm::decode(start, block.get(), dspYn[j][0], dspYn[j][1],
                          coefficients[j], frameCount, startSample);
-        auto calcedCoefs = dspadpcm::calculateCoefficients(block.get(), frameCount);
-        static bool wasPrinted = false;
-        if (!wasPrinted) {
-            for (int i = 0; i < 8; ++i) {
-                for (int k = 0; k < 2; ++k) {
-                    std::cout << "Coefficients Real[" << i << "][" << k << "] = " << coefficients[j][i][k] << " Calc["
-                              << i << "][" << k << "] = " << calcedCoefs[k + i * 2] << std::endl;
-                }
-            }
-            wasPrinted = true;
-        }
+    }
+    writeFun(reinterpret_cast<void **>(decodedBlocks.data()), frameCount);
+    return 0;
+}
 
+/**
+ *
+ * @param channelNum Number of played channels
+ * @param startChannel Start channel index
+ * @param frameCount Number of frames to be played
+ * @param startSample The first sample where playback should start
+ * @param thisBlockSizeRaw
+ * @param offsetDataPtr
+ * @param imaContext The predictor and step index for ima-adpcm playback (must correspond to the block start)
+ * @param writeFun the function that is responsable to write the data. It takes a pointer to multiple buffers (amount is channel count) and the frame count
+ * @return
+ */
+int decodeFrameBlockIMA(uint32_t channelNum, uint32_t startChannel, uint32_t frameCount, uint32_t startSample,
+                        uint32_t thisBlockSizeRaw,
+                        const void *offsetDataPtr, std::shared_ptr<IMAAdpcmContext[]> &imaContext,
+                        const std::function<void(void **, uint32_t)> &writeFun) {
+    auto decodedBlocks = std::vector<std::unique_ptr<int16_t[]>>();
+    auto sources = std::vector<const uint8_t *>();
+    auto predictors = std::vector<int16_t>();
+    auto stepIndices = std::vector<uint8_t>();
+    for (uint32_t j = startChannel; j < channelNum + startChannel; ++j) {
+        decodedBlocks.emplace_back(std::make_unique_for_overwrite<int16_t[]>(frameCount));
+        sources.emplace_back(static_cast<const uint8_t *>(offsetDataPtr) + j * thisBlockSizeRaw);
+        predictors.emplace_back(imaContext[j].predictor);
+        stepIndices.emplace_back(imaContext[j].stepIndex);
+    }
+    if (startSample == 0) {
+        imaadpcm::decodeMulti(sources.data(), reinterpret_cast<int16_t *const *>(decodedBlocks.data()),
+                              predictors.data(), stepIndices.data(), channelNum, frameCount);
+    } else {
+        for (uint32_t j = 0; j < channelNum; ++j) {
+            imaadpcm::decode(sources[j], decodedBlocks[j].get(), predictors[j], stepIndices[j], frameCount,
+                             startSample);
+        }
+    }
+    for (uint32_t j = 0; j < channelNum; ++j) {
+        imaContext[j + startChannel] = {predictors[j], stepIndices[j]};
     }
     writeFun(reinterpret_cast<void **>(decodedBlocks.data()), frameCount);
     return 0;
@@ -8,17 +8,28 @@
 #include <functional>
 
 class BfstmContext;
+struct IMAAdpcmContext;
 
 void initLoopDspYn(const BfstmContext &context, std::shared_ptr<int16_t[][2]> &dspYn);
 
-void
-initDspYn(const BfstmContext &context, const void *histPtr, uint32_t blockIndex, std::shared_ptr<int16_t[][2]> &dspYn);
+/**
+ * Loads the history of the block start from the seek table.
+ * @return false if the stream has no seek table or no such block, dspYn is unchanged then
+ */
+bool initDspYn(const BfstmContext &context, uint32_t blockIndex, std::shared_ptr<int16_t[][2]> &dspYn);
 
 void initRegionDspYn(const BfstmContext &context, uint32_t regionIndex, std::shared_ptr<int16_t[][2]> &dspYn);
 
 void initDsp(const BfstmContext &context, std::shared_ptr<int16_t[][8][2]> &coefficients,
              std::shared_ptr<int16_t[][2]> &dspYn);
 
+void initIma(const BfstmContext &context, std::shared_ptr<IMAAdpcmContext[]> &imaContext);
+
+void initLoopIma(const BfstmContext &context, std::shared_ptr<IMAAdpcmContext[]> &imaContext);
+
+void initImaAt(const BfstmContext &context, const void *dataPtr, uint32_t blockIndex,
+               std::shared_ptr<IMAAdpcmContext[]> &imaContext);
+
 int decodeFrameBlockSimple(uint32_t channelNum, uint32_t startChannel, uint32_t frameCount, uint32_t startByte,
                            uint32_t thisBlockSizeRaw,
                            const void *offsetDataPtr,
@@ -29,3 +40,8 @@ int decodeFrameBlockDSP(uint32_t channelNum, uint32_t startChannel, uint32_t fra
                         const void *offsetDataPtr, const std::shared_ptr<int16_t[][8][2]> &coefficients,
                         std::shared_ptr<int16_t[][2]> &dspYn,
                         const std::function<void(void **, uint32_t)> &writeFun);
+
+int decodeFrameBlockIMA(uint32_t channelNum, uint32_t startChannel, uint32_t frameCount, uint32_t startSample,
+                        uint32_t thisBlockSizeRaw,
+                        const void *offsetDataPtr, std::shared_ptr<IMAAdpcmContext[]> &imaContext,
+                        const std::function<void(void **, uint32_t)> &writeFun);
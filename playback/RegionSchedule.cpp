@@ -0,0 +1,81 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <algorithm>
+#include <iostream>
+#include "RegionSchedule.h"
+#include "../codec/ImaADPCM.h"
+#include "../format/bfstm/BfstmBlocks.h"
+#include "../format/bfstm/BfstmDecoder.h"
+#include "../format/bfstm/BfstmFile.h"
+
+RegionSchedule::RegionSchedule(const BfstmContext &context, const void *dataPtr) {
+    const uint32_t blockSizeSamples = context.streamInfo.blockSizeSamples;
+    const uint32_t sampleCount = getStreamSampleCount(context.streamInfo);
+    m_RegionStarts.push_back(0);
+    for (const auto &[region, contexts]: context.regionInfos) {
+        if (region.startSample >= region.endSample || region.endSample > sampleCount || blockSizeSamples == 0) {
+            std::cerr << "Region " << region.startSample << " - " << region.endSample << " is invalid!" << std::endl;
+            success = false;
+            return;
+        }
+        for (uint32_t sample = region.startSample; sample < region.endSample;) {
+            uint32_t block = sample / blockSizeSamples;
+            uint32_t blockEnd = std::min((block + 1) * blockSizeSamples, sampleCount);
+            uint32_t frameCount = std::min(blockEnd, region.endSample) - sample;
+            m_Steps.push_back({block, sample % blockSizeSamples, frameCount, sample == region.startSample, false});
+            sample += frameCount;
+        }
+        m_Steps.back().isRegionEnd = true;
+        m_RegionStarts.push_back(m_Steps.size());
+    }
+    if (context.streamInfo.soundEncoding == SoundEncoding::IMA_ADPCM) {
+        if (!dataPtr || context.channelInfos.size() != context.streamInfo.channelNum) {
+            std::cerr << "Ima-adpcm regions need the sample data and channel infos!" << std::endl;
+            success = false;
+            return;
+        }
+        buildImaContexts(context, dataPtr);
+    }
+}
+
+void RegionSchedule::buildImaContexts(const BfstmContext &context, const void *dataPtr) {
+    m_ChannelNum = context.streamInfo.channelNum;
+    const uint32_t regionCount = getRegionCount();
+    m_ImaContexts.resize(regionCount * m_ChannelNum);
+    // Regions ordered by their first block, so the stream is decoded only once up to the last one
+    std::vector<uint32_t> order(regionCount);
+    for (uint32_t region = 0; region < regionCount; ++region) {
+        order[region] = region;
+    }
+    std::ranges::sort(order, {}, [this](uint32_t region) {
+        return getSteps(region)[0].block;
+    });
+
+    BfstmBlockRange blocks{context, dataPtr};
+    std::vector<int16_t> scratch(context.streamInfo.blockSizeSamples);
+    for (uint32_t ch = 0; ch < m_ChannelNum; ++ch) {
+        IMAAdpcmContext ima = get<BfstmIMAADPCMChannelInfo>(context.channelInfos[ch]).startContext;
+        uint32_t block = 0;
+        for (uint32_t region: order) {
+            for (; block < getSteps(region)[0].block; ++block) {
+                const BfstmBlock decoded = blocks[block];
+                imaadpcm::decode(decoded.getChannelPtr(ch), scratch.data(), ima.predictor, ima.stepIndex,
+                                 decoded.sampleCount, 0);
+            }
+            m_ImaContexts[region * m_ChannelNum + ch] = ima;
+        }
+    }
+}
+
+uint32_t RegionSchedule::findStep(uint32_t region, uint32_t block, uint32_t sampleInBlock) const {
+    auto steps = getSteps(region);
+    for (uint32_t i = 0; i < steps.size(); ++i) {
+        const RegionStep &step = steps[i];
+        if (step.block == block && sampleInBlock < step.startSampleInBlock + step.frameCount) {
+            return i;
+        }
+    }
+    return npos;
+}
@@ -0,0 +1,72 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+struct BfstmContext;
+struct IMAAdpcmContext;
+
+struct RegionStep {
+    uint32_t block;
+    // The first sample of the step inside the block
+    uint32_t startSampleInBlock;
+    uint32_t frameCount;
+    // The decoder state has to be reloaded (region context or block start) before the step
+    bool reloadContext;
+    // The last step of its region, playback continues with the first step of the next region
+    bool isRegionEnd;
+};
+
+/**
+ * The regions of a stream compiled once into a flat array of steps, one per played (part of a) block. The audio thread
+ * only walks the steps, it doesn't compare region boundaries while playing.
+ */
+class RegionSchedule {
+public:
+    static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+    /**
+     * @param dataPtr Needed for ima-adpcm streams, the decoder state at the first block of every region is decoded
+     * here once instead of on the audio thread
+     */
+    explicit RegionSchedule(const BfstmContext &context, const void *dataPtr = nullptr);
+
+    [[nodiscard]] uint32_t getRegionCount() const {
+        return m_RegionStarts.size() - 1;
+    }
+
+    [[nodiscard]] std::span<const RegionStep> getSteps(uint32_t region) const {
+        return std::span{m_Steps}.subspan(m_RegionStarts[region], m_RegionStarts[region + 1] - m_RegionStarts[region]);
+    }
+
+    /**
+     * @return The step of the region that plays the sample of the block or npos if the region doesn't contain it
+     */
+    [[nodiscard]] uint32_t findStep(uint32_t region, uint32_t block, uint32_t sampleInBlock) const;
+
+    /**
+     * Only for ima-adpcm streams.
+     * @return The state of every channel at the start of the first block of the region
+     */
+    [[nodiscard]] std::span<const IMAAdpcmContext> getImaContexts(uint32_t region) const {
+        return std::span{m_ImaContexts}.subspan(region * m_ChannelNum, m_ChannelNum);
+    }
+
+    // false if a region is empty or outside the stream
+    bool success = true;
+private:
+    void buildImaContexts(const BfstmContext &context, const void *dataPtr);
+
+    std::vector<RegionStep> m_Steps;
+    // Index of the first step of every region and the end
+    std::vector<uint32_t> m_RegionStarts;
+    // Indexed by region * channelNum + channel
+    std::vector<IMAAdpcmContext> m_ImaContexts;
+    uint32_t m_ChannelNum = 0;
+};
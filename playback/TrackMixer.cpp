@@ -0,0 +1,131 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <algorithm>
+#include <iostream>
+#include "TrackMixer.h"
+#include "../codec/DspADPCM.h"
+#include "../format/bfstm/BfstmFile.h"
+
+TrackMixer::TrackMixer(const BfstmContext &context) : m_ChannelNum(context.streamInfo.channelNum) {
+    const uint32_t channelNum = m_ChannelNum;
+    for (const auto &trackInfo: context.trackInfos) {
+        Track &track = m_Tracks.emplace_back();
+        // Track volume 127 is unity gain, pan 64 is center
+        track.volume = trackInfo.volume / 127.0f;
+        track.pan = std::clamp((trackInfo.pan - 64) / 63.0f, -1.0f, 1.0f);
+        for (uint8_t channel: trackInfo.channelIndices) {
+            if (channel < channelNum) {
+                track.channels.push_back(channel);
+            } else {
+                std::cerr << "Track channel " << static_cast<int>(channel) << " does not exist!" << std::endl;
+            }
+        }
+    }
+    if (m_Tracks.empty()) {
+        for (uint32_t channel = 0; channel < channelNum; channel += 2) {
+            Track &track = m_Tracks.emplace_back();
+            track.channels.push_back(channel);
+            if (channel + 1 < channelNum) track.channels.push_back(channel + 1);
+        }
+    }
+    for (auto &track: m_Tracks) {
+        for (uint32_t i = 0; i < track.channels.size(); ++i) {
+            track.current.push_back(getTargetGain(track, i));
+        }
+    }
+}
+
+sampleconv::StereoGain TrackMixer::getTargetGain(const Track &track, uint32_t index) {
+    if (track.muted) return {0.0f, 0.0f};
+    float gain = track.volume * track.gain;
+    if (track.channels.size() == 1) {
+        return sampleconv::getPanGain(gain, track.pan);
+    }
+    // Multichannel tracks alternate left and right, the pan is a balance then
+    if (index % 2 == 0) {
+        return {gain * std::min(1.0f, 1.0f - track.pan), 0.0f};
+    }
+    return {0.0f, gain * std::min(1.0f, 1.0f + track.pan)};
+}
+
+void TrackMixer::mix(const int16_t *const *channels, int16_t *const *stereo, uint32_t frames) {
+    m_Left.assign(frames, 0.0f);
+    m_Right.assign(frames, 0.0f);
+    for (auto &track: m_Tracks) {
+        for (uint32_t i = 0; i < track.channels.size(); ++i) {
+            sampleconv::StereoGain target = getTargetGain(track, i);
+            sampleconv::StereoGain &current = track.current[i];
+            if (current.left == 0.0f && current.right == 0.0f && target.left == 0.0f && target.right == 0.0f) {
+                continue;
+            }
+            sampleconv::mixS16(channels[track.channels[i]], m_Left.data(), m_Right.data(), frames, current, target);
+            current = target;
+        }
+    }
+    sampleconv::f32ToS16(m_Left.data(), stereo[0], frames);
+    sampleconv::f32ToS16(m_Right.data(), stereo[1], frames);
+}
+
+void TrackMixer::mixDsp(const uint8_t *const *channels, const int16_t (*coefficients)[8][2], int16_t (*dspYn)[2],
+                        uint32_t startSample, int16_t *const *stereo, uint32_t frames) {
+    m_Left.assign(frames, 0.0f);
+    m_Right.assign(frames, 0.0f);
+    m_Mix.assign(frames * 2, 0.0f);
+    m_Decoded.resize(frames);
+    // Channels of several tracks are decoded from the same history, it is advanced once all tracks are mixed
+    m_EndYn.assign(m_ChannelNum, {});
+    m_HasEndYn.assign(m_ChannelNum, 0);
+    for (auto &track: m_Tracks) {
+        for (uint32_t i = 0; i < track.channels.size(); ++i) {
+            uint8_t channel = track.channels[i];
+            sampleconv::StereoGain target = getTargetGain(track, i);
+            sampleconv::StereoGain &current = track.current[i];
+            if (current.left == 0.0f && current.right == 0.0f && target.left == 0.0f && target.right == 0.0f) {
+                continue;
+            }
+            int16_t yn1 = dspYn[channel][0];
+            int16_t yn2 = dspYn[channel][1];
+            if (current.left == target.left && current.right == target.right) {
+                dspadpcm::decodeMix(channels[channel], m_Mix.data(), yn1, yn2, coefficients[channel], frames,
+                                    startSample, target);
+            } else {
+                dspadpcm::decode(channels[channel], m_Decoded.data(), yn1, yn2, coefficients[channel], frames,
+                                 startSample);
+                sampleconv::mixS16(m_Decoded.data(), m_Left.data(), m_Right.data(), frames, current, target);
+                current = target;
+            }
+            m_EndYn[channel] = {yn1, yn2};
+            m_HasEndYn[channel] = 1;
+        }
+    }
+    for (uint32_t channel = 0; channel < m_ChannelNum; ++channel) {
+        if (m_HasEndYn[channel]) {
+            dspYn[channel][0] = m_EndYn[channel][0];
+            dspYn[channel][1] = m_EndYn[channel][1];
+        } else {
+            // Silent channels still have to keep their history
+            dspadpcm::decode(channels[channel], m_Decoded.data(), dspYn[channel][0], dspYn[channel][1],
+                             coefficients[channel], frames, startSample);
+        }
+    }
+    for (uint32_t i = 0; i < frames; ++i) {
+        m_Left[i] += m_Mix[i * 2];
+        m_Right[i] += m_Mix[i * 2 + 1];
+    }
+    sampleconv::f32ToS16(m_Left.data(), stereo[0], frames);
+    sampleconv::f32ToS16(m_Right.data(), stereo[1], frames);
+}
+
+std::vector<sampleconv::StereoGain> TrackMixer::getChannelGains() const {
+    std::vector<sampleconv::StereoGain> gains(m_ChannelNum, sampleconv::StereoGain{0.0f, 0.0f});
+    for (const auto &track: m_Tracks) {
+        for (uint32_t i = 0; i < track.channels.size(); ++i) {
+            sampleconv::StereoGain gain = getTargetGain(track, i);
+            gains[track.channels[i]].left += gain.left;
+            gains[track.channels[i]].right += gain.right;
+        }
+    }
+    return gains;
+}
@@ -0,0 +1,95 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "../codec/SampleConvert.h"
+
+struct BfstmContext;
+
+/**
+ * Mixes all tracks of a stream down to stereo with the volume and pan of their track info. Gain and mute of every
+ * track can be changed from any thread while mixing, the change is ramped over the next mix() call.
+ * Streams without track info get one track per channel pair.
+ */
+class TrackMixer {
+public:
+    explicit TrackMixer(const BfstmContext &context);
+
+    [[nodiscard]] uint32_t getTrackCount() const {
+        return m_Tracks.size();
+    }
+
+    /**
+     * @param gain Linear gain on top of the track volume
+     */
+    void setTrackGain(uint32_t track, float gain) {
+        m_Tracks[track].gain = gain;
+    }
+
+    [[nodiscard]] float getTrackGain(uint32_t track) const {
+        return m_Tracks[track].gain;
+    }
+
+    void setTrackMuted(uint32_t track, bool muted) {
+        m_Tracks[track].muted = muted;
+    }
+
+    [[nodiscard]] bool isTrackMuted(uint32_t track) const {
+        return m_Tracks[track].muted;
+    }
+
+    /**
+     * Only call this from the audio thread!
+     * @param channels Decoded pcm16 of all stream channels
+     * @param stereo Left and right output buffer
+     */
+    void mix(const int16_t *const *channels, int16_t *const *stereo, uint32_t frames);
+
+    /**
+     * Same as mix(), but decodes the dsp-adpcm channels of a block itself. Channels with a steady gain are decoded
+     * straight into the mix (see dspadpcm::decodeMix), only ramping channels go through pcm16. Only call this from
+     * the audio thread!
+     * @param channels Sample data of all stream channels in the block
+     * @param dspYn History of every channel at the start of the frame that contains startSample, it is advanced
+     * @param startSample The first sample in the block
+     */
+    void mixDsp(const uint8_t *const *channels, const int16_t (*coefficients)[8][2], int16_t (*dspYn)[2],
+                uint32_t startSample, int16_t *const *stereo, uint32_t frames);
+
+    /**
+     * @return The current gain of every stream channel, channels of several tracks get the sum
+     */
+    [[nodiscard]] std::vector<sampleconv::StereoGain> getChannelGains() const;
+
+private:
+    struct Track {
+        std::vector<uint8_t> channels;
+        float volume = 1.0f;
+        // -1 is left, 0 is center and 1 is right
+        float pan = 0.0f;
+        std::atomic<float> gain = 1.0f;
+        std::atomic_bool muted = false;
+        // The gains of the channels at the end of the last mix
+        std::vector<sampleconv::StereoGain> current;
+    };
+
+    static sampleconv::StereoGain getTargetGain(const Track &track, uint32_t index);
+
+    std::deque<Track> m_Tracks;
+    uint32_t m_ChannelNum;
+    std::vector<float> m_Left;
+    std::vector<float> m_Right;
+    // Interleaved stereo, the dsp-adpcm channels with a steady gain are decoded into it
+    std::vector<float> m_Mix;
+    std::vector<int16_t> m_Decoded;
+    // The dsp-adpcm history of every channel after the block, valid if a track decoded the channel
+    std::vector<std::array<int16_t, 2>> m_EndYn;
+    std::vector<uint8_t> m_HasEndYn;
+};
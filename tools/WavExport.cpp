@@ -0,0 +1,359 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include "WavExport.h"
+#include "../MemoryResource.h"
+#include "../ThreadPool.h"
+#include "../codec/DspADPCM.h"
+#include "../codec/Resampler.h"
+#include "../codec/SampleConvert.h"
+#include "../format/bfstm/BfstmDecoder.h"
+#include "../format/bfstm/BfstmReader.h"
+#include "../format/bfstm/BfstmSeekIndex.h"
+#include "../format/bfwav/BfwavReader.h"
+#include "../format/wav/WavWriter.h"
+#include "../playback/TrackMixer.h"
+
+namespace {
+    struct DecodedAudio {
+        WavInfo info{};
+        // Planar, channel after channel
+        std::vector<int16_t> samples;
+    };
+
+    struct ExportResult {
+        bool success = false;
+        double audioSeconds = 0;
+        uint64_t inputBytes = 0;
+        uint64_t outputBytes = 0;
+    };
+
+    bool hasExtension(const std::filesystem::path &path, std::string_view extension) {
+        std::string ext = path.extension().string();
+        std::ranges::transform(ext, ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        return ext == extension;
+    }
+
+    bool isExportable(const std::filesystem::path &path) {
+        return hasExtension(path, ".bfstm") || hasExtension(path, ".bfwav");
+    }
+
+    uint64_t getBytesForSamples(SoundEncoding encoding, uint32_t sampleCount) {
+        switch (encoding) {
+            case SoundEncoding::PCM8:
+                return sampleCount;
+            case SoundEncoding::PCM16:
+                return sampleCount * sizeof(int16_t);
+            case SoundEncoding::DSP_ADPCM:
+                return dspadpcm::getBytesForSamples(sampleCount);
+            case SoundEncoding::IMA_ADPCM:
+                return (static_cast<uint64_t>(sampleCount) + 1) / 2;
+            default:
+                return 0;
+        }
+    }
+
+    // The blocks are decoded straight from the file, a truncated stream would be read out of bounds
+    bool verifyBlocksInBounds(const BfstmContext &context, uint64_t fileSize) {
+        const auto &streamInfo = context.streamInfo;
+        const auto &dataSection = *context.header.dataSection;
+        if (streamInfo.blockCountPerChannel == 0 || streamInfo.sampleDataOffset < 0) {
+            std::cerr << "Stream has no sample data!" << std::endl;
+            return false;
+        }
+        if (getBytesForSamples(streamInfo.soundEncoding, streamInfo.blockSizeSamples) > streamInfo.blockSizeBytes ||
+            getBytesForSamples(streamInfo.soundEncoding, streamInfo.lastBlockSizeSamples) >
+            streamInfo.lastBlockSizeBytesRaw) {
+            std::cerr << "Stream block sizes do not fit their samples!" << std::endl;
+            return false;
+        }
+        uint64_t dataBytes = static_cast<uint64_t>(streamInfo.blockCountPerChannel - 1) * streamInfo.channelNum *
+                             streamInfo.blockSizeBytes +
+                             static_cast<uint64_t>(streamInfo.channelNum) * streamInfo.lastBlockSizeBytesRaw;
+        uint64_t dataStart = 0x8 + static_cast<uint64_t>(streamInfo.sampleDataOffset);
+        if (dataSection.offset < 0 || dataStart + dataBytes > dataSection.size ||
+            static_cast<uint64_t>(dataSection.offset) + dataStart + dataBytes > fileSize) {
+            std::cerr << "Stream sample data is out of bounds!" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Moves the loop to the samples after start, a loop that ends before it is dropped
+    void startLoopAt(DecodedAudio &audio, uint32_t startSample) {
+        if (!audio.info.loop) return;
+        if (audio.info.loop->endSample <= startSample) {
+            audio.info.loop.reset();
+            return;
+        }
+        audio.info.loop = WavLoop{std::max(audio.info.loop->startSample, startSample) - startSample,
+                                  audio.info.loop->endSample - startSample};
+    }
+
+    // Mixes the whole stream with the track gains and keeps the frames from startSample on as planar stereo
+    bool downmixBfstm(const BfstmContext &context, const void *dataPtr, uint32_t startSample, ThreadPool &pool,
+                      DecodedAudio &audio) {
+        uint32_t sampleCount = getStreamSampleCount(context.streamInfo);
+        std::vector<float> mix(static_cast<size_t>(sampleCount) * 2, 0.0f);
+        auto gains = TrackMixer{context}.getChannelGains();
+        if (!decodeBfstmMix(context, dataPtr, mix.data(), gains, pool)) return false;
+        std::vector<int16_t> interleaved(static_cast<size_t>(audio.info.sampleCount) * 2);
+        sampleconv::f32ToS16(mix.data() + static_cast<size_t>(startSample) * 2, interleaved.data(), interleaved.size());
+        std::array<int16_t *, 2> stereo{audio.samples.data(), audio.samples.data() + audio.info.sampleCount};
+        sampleconv::deinterleaveS16(interleaved.data(), stereo.data(), 2, audio.info.sampleCount);
+        return true;
+    }
+
+    bool decodeBfstmFile(const MemoryResource &resource, uint64_t fileSize, const WavExportSettings &settings,
+                         ThreadPool &pool, DecodedAudio &audio) {
+        uint32_t startSample = settings.startSample;
+        BfstmReader reader{resource};
+        if (!reader.success) return false;
+        if (!reader.checksumValid) {
+            std::cerr << "Exporting stream with invalid checksum!" << std::endl;
+        }
+        const BfstmContext &context = reader.m_Context;
+        if (!verifyBlocksInBounds(context, fileSize)) return false;
+        const auto &streamInfo = context.streamInfo;
+        bool downmix = settings.downmix && streamInfo.channelNum >= 2;
+        audio.info.channelNum = downmix ? 2 : streamInfo.channelNum;
+        audio.info.sampleRate = streamInfo.sampleRate;
+        uint32_t sampleCount = getStreamSampleCount(streamInfo);
+        if (startSample >= sampleCount) {
+            std::cerr << "Start sample " << startSample << " is after the stream end!" << std::endl;
+            return false;
+        }
+        if (streamInfo.isLoop) {
+            audio.info.loop = WavLoop{streamInfo.loopStart, std::min(streamInfo.loopEnd, sampleCount)};
+        }
+        startLoopAt(audio, startSample);
+        audio.info.sampleCount = sampleCount - startSample;
+        audio.samples.resize(static_cast<size_t>(audio.info.sampleCount) * audio.info.channelNum);
+        const void *dataPtr = resource.getAsPtrUnsafe(context.header.dataSection->offset + 0x8 +
+                                                      streamInfo.sampleDataOffset);
+        if (downmix) return downmixBfstm(context, dataPtr, startSample, pool, audio);
+        std::unique_ptr<BfstmSeekIndex> index;
+        if (startSample != 0 && streamInfo.soundEncoding == SoundEncoding::DSP_ADPCM) {
+            index = std::make_unique<BfstmSeekIndex>(context, dataPtr);
+        }
+        return decodeBfstm(context, dataPtr, audio.samples.data(), pool, startSample, index.get());
+    }
+
+    bool decodeBfwavFile(const MemoryResource &resource, uint64_t fileSize, uint32_t startSample, ThreadPool &pool,
+                         DecodedAudio &audio) {
+        BfwavReader reader{resource};
+        if (!reader.wasReadSuccess()) return false;
+        BfwavReadContext context = reader.getContext();
+        uint32_t sampleCount = context.sampleCount;
+        if (context.format >= SoundEncoding::IMA_ADPCM) {
+            std::cerr << "Cannot export " << context.format << " wave!" << std::endl;
+            return false;
+        }
+        if (startSample >= sampleCount) {
+            std::cerr << "Start sample " << startSample << " is after the wave end!" << std::endl;
+            return false;
+        }
+        uint64_t channelBytes = getBytesForSamples(context.format, sampleCount);
+        for (uint32_t offset: context.channelDataOffsets) {
+            if (reader.getDataOffset() + static_cast<uint64_t>(offset) + channelBytes > fileSize) {
+                std::cerr << "Wave channel data is out of bounds!" << std::endl;
+                return false;
+            }
+        }
+        audio.info.channelNum = context.channelNum;
+        audio.info.sampleRate = context.sampleRate;
+        audio.info.sampleCount = sampleCount;
+        if (context.loopInfo && context.loopInfo->loopStartSample < sampleCount) {
+            audio.info.loop = WavLoop{context.loopInfo->loopStartSample, sampleCount};
+        }
+        startLoopAt(audio, startSample);
+        audio.info.sampleCount = sampleCount - startSample;
+        audio.samples.resize(static_cast<size_t>(audio.info.sampleCount) * context.channelNum);
+        pool.parallelFor(context.channelNum, [&](uint32_t ch) {
+            const void *src = resource.getAsPtrUnsafe(reader.getDataOffset() + context.channelDataOffsets[ch]);
+            int16_t *dst = audio.samples.data() + static_cast<size_t>(ch) * audio.info.sampleCount;
+            if (context.format == SoundEncoding::DSP_ADPCM) {
+                // Waves have no seek table, the samples before the start are decoded and dropped
+                const auto &dsp = context.dspAdpcmChannelInfo[ch];
+                int16_t yn1 = dsp.startContext.yn1;
+                int16_t yn2 = dsp.startContext.yn2;
+                std::vector<int16_t> skipped(startSample / 14 * 14);
+                dspadpcm::decode(static_cast<const uint8_t *>(src), skipped.data(), yn1, yn2, dsp.coefficients,
+                                 skipped.size(), 0);
+                dspadpcm::decode(static_cast<const uint8_t *>(src) + skipped.size() / 14 * 8, dst, yn1, yn2,
+                                 dsp.coefficients, audio.info.sampleCount, startSample % 14);
+            } else if (context.format == SoundEncoding::PCM16) {
+                const int16_t *start = static_cast<const int16_t *>(src) + startSample;
+                if (reader.isByteOrderSwapped()) {
+                    sampleconv::bswapS16(start, dst, audio.info.sampleCount);
+                } else {
+                    std::memcpy(dst, start, audio.info.sampleCount * sizeof(int16_t));
+                }
+            } else {
+                sampleconv::s8ToS16(static_cast<const int8_t *>(src) + startSample, dst, audio.info.sampleCount);
+            }
+        });
+        return true;
+    }
+
+    // Frames that are resampled at once, keeps the float history of the resampler small
+    constexpr uint32_t RESAMPLE_CHUNK = 0x10000;
+
+    void resampleAudio(DecodedAudio &audio, uint32_t outputRate, ThreadPool &pool) {
+        const WavInfo &info = audio.info;
+        // The flushed filter may produce a frame more or less, the channels are cut or padded to the exact length
+        const auto sampleCount = static_cast<uint32_t>(static_cast<uint64_t>(info.sampleCount) * outputRate /
+                                                       info.sampleRate);
+        std::vector<int16_t> samples(static_cast<size_t>(sampleCount) * info.channelNum);
+        pool.parallelFor(info.channelNum, [&](uint32_t ch) {
+            Resampler resampler{info.sampleRate, outputRate, 1};
+            const int16_t *src = audio.samples.data() + static_cast<size_t>(ch) * info.sampleCount;
+            int16_t *dst = samples.data() + static_cast<size_t>(ch) * sampleCount;
+            std::vector<int16_t> buffer;
+            size_t written = 0;
+            auto append = [&](size_t produced) {
+                size_t count = std::min(produced, sampleCount - written);
+                std::memcpy(dst + written, buffer.data(), count * sizeof(int16_t));
+                written += count;
+            };
+            for (uint32_t start = 0; start < info.sampleCount; start += RESAMPLE_CHUNK) {
+                uint32_t count = std::min(RESAMPLE_CHUNK, info.sampleCount - start);
+                buffer.resize(resampler.getMaxOutputFrames(count));
+                const int16_t *in = src + start;
+                int16_t *out = buffer.data();
+                append(resampler.process(&in, count, &out));
+            }
+            buffer.resize(resampler.getMaxOutputFrames(0));
+            int16_t *out = buffer.data();
+            append(resampler.flush(&out));
+        });
+        if (audio.info.loop) {
+            auto scale = [&](uint32_t sample) {
+                return static_cast<uint32_t>(static_cast<uint64_t>(sample) * outputRate / info.sampleRate);
+            };
+            audio.info.loop = WavLoop{scale(audio.info.loop->startSample),
+                                      std::min(scale(audio.info.loop->endSample), sampleCount)};
+        }
+        audio.info.sampleRate = outputRate;
+        audio.info.sampleCount = sampleCount;
+        audio.samples = std::move(samples);
+    }
+
+    ExportResult exportFile(const WavExportFile &file, const std::filesystem::path &outDir,
+                            const WavExportSettings &settings, ThreadPool &pool) {
+        ExportResult result{};
+        std::error_code error;
+        result.inputBytes = std::filesystem::file_size(file.input, error);
+        if (error || result.inputBytes < 4) {
+            std::cerr << "Cannot read " << file.input << std::endl;
+            return result;
+        }
+        std::ifstream in{file.input, std::ios::binary};
+        if (!in) {
+            std::cerr << "Cannot open " << file.input << std::endl;
+            return result;
+        }
+        MemoryResource resource{in};
+        DecodedAudio audio{};
+        bool decoded;
+        try {
+            std::string_view magic{static_cast<const char *>(resource.getAsPtrUnsafe(0)), 4};
+            if (magic == "FSTM") {
+                decoded = decodeBfstmFile(resource, result.inputBytes, settings, pool, audio);
+            } else if (magic == "FWAV") {
+                decoded = decodeBfwavFile(resource, result.inputBytes, settings.startSample, pool, audio);
+            } else {
+                std::cerr << file.input << " is no bfstm or bfwav!" << std::endl;
+                return result;
+            }
+        } catch (const std::out_of_range &e) {
+            std::cerr << file.input << " is truncated: " << e.what() << std::endl;
+            return result;
+        }
+        if (!decoded) {
+            std::cerr << "Cannot decode " << file.input << std::endl;
+            return result;
+        }
+        uint32_t outputRate = settings.outputRate;
+        if (outputRate != 0 && audio.info.sampleRate != 0 && outputRate != audio.info.sampleRate) {
+            resampleAudio(audio, outputRate, pool);
+        }
+
+        std::filesystem::path outPath = outDir / file.output;
+        std::filesystem::create_directories(outPath.parent_path(), error);
+        std::ofstream out{outPath, std::ios::binary};
+        std::vector<const int16_t *> channels(audio.info.channelNum);
+        for (uint32_t ch = 0; ch < audio.info.channelNum; ++ch) {
+            channels[ch] = audio.samples.data() + static_cast<size_t>(ch) * audio.info.sampleCount;
+        }
+        if (!out || !writeWav(out, audio.info, channels.data())) {
+            std::cerr << "Cannot write " << outPath << std::endl;
+            return result;
+        }
+        result.success = true;
+        result.outputBytes = getWavFileSize(audio.info);
+        if (audio.info.sampleRate != 0) {
+            result.audioSeconds = static_cast<double>(audio.info.sampleCount) / audio.info.sampleRate;
+        }
+        return result;
+    }
+}
+
+std::vector<WavExportFile> collectWavExportFiles(std::span<const std::filesystem::path> paths) {
+    std::vector<WavExportFile> files;
+    for (const auto &path: paths) {
+        if (!std::filesystem::is_directory(path)) {
+            files.push_back({path, std::filesystem::path{path.filename()}.replace_extension(".wav")});
+            continue;
+        }
+        for (const auto &entry: std::filesystem::recursive_directory_iterator{path}) {
+            if (entry.is_regular_file() && isExportable(entry.path())) {
+                auto output = std::filesystem::relative(entry.path(), path).replace_extension(".wav");
+                files.push_back({entry.path(), output});
+            }
+        }
+    }
+    return files;
+}
+
+bool exportWavs(std::ostream &out, std::span<const WavExportFile> files, const std::filesystem::path &outDir,
+                ThreadPool &pool, const WavExportSettings &settings) {
+    std::vector<ExportResult> results(files.size());
+    auto start = std::chrono::steady_clock::now();
+    // Every file task decodes its blocks on the same pool
+    pool.parallelFor(files.size(), [&](uint32_t i) {
+        results[i] = exportFile(files[i], outDir, settings, pool);
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint32_t exported = 0;
+    double audioSeconds = 0;
+    uint64_t inputBytes = 0, outputBytes = 0;
+    for (uint32_t i = 0; i < files.size(); ++i) {
+        const ExportResult &result = results[i];
+        if (!result.success) {
+            out << "  FAILED " << files[i].input.string() << std::endl;
+            continue;
+        }
+        ++exported;
+        audioSeconds += result.audioSeconds;
+        inputBytes += result.inputBytes;
+        outputBytes += result.outputBytes;
+    }
+    out << "Exported " << exported << " of " << files.size() << " files (" << audioSeconds << " s audio) in "
+        << seconds << " s with " << pool.getThreadCount() + 1 << " threads" << std::endl;
+    if (seconds > 0) {
+        out << "  " << audioSeconds / seconds << "x realtime, " << inputBytes / seconds / 1e6 << " MB/s read, "
+            << outputBytes / seconds / 1e6 << " MB/s written" << std::endl;
+    }
+    return exported == files.size();
+}
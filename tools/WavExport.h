@@ -0,0 +1,42 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <span>
+#include <vector>
+
+class ThreadPool;
+
+struct WavExportFile {
+    std::filesystem::path input;
+    // Relative to the output directory
+    std::filesystem::path output;
+};
+
+/**
+ * Collects every bfstm and bfwav file of the paths. Directories are searched recursively and keep their structure
+ * in the output paths.
+ */
+std::vector<WavExportFile> collectWavExportFiles(std::span<const std::filesystem::path> paths);
+
+struct WavExportSettings {
+    // Sample rate of the wavs, files with another rate are resampled (see Resampler). 0 keeps the rate.
+    uint32_t outputRate = 0;
+    // The first exported sample, dsp-adpcm streams seek there with a BfstmSeekIndex
+    uint32_t startSample = 0;
+    // Mixes the tracks of multichannel streams to stereo with their volume and pan like playback does (see TrackMixer)
+    bool downmix = false;
+};
+
+/**
+ * Decodes every file to a pcm16 wav in outDir. The files are decoded in parallel and the blocks of one file too
+ * (see decodeBfstm). Stream loops are written to a smpl chunk. Reports throughput as realtime multiple and MB/s.
+ * @return true if all files were exported
+ */
+bool exportWavs(std::ostream &out, std::span<const WavExportFile> files, const std::filesystem::path &outDir,
+                ThreadPool &pool, const WavExportSettings &settings = {});
@@ -0,0 +1,272 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "WavImport.h"
+#include "../BoundedQueue.h"
+#include "../ThreadPool.h"
+#include "../codec/EncodeMetrics.h"
+#include "../format/bfstm/BfstmEncoder.h"
+#include "../format/bfstm/BfstmWriter.h"
+#include "../format/wav/WavReader.h"
+
+namespace {
+    struct EncodedBlock {
+        std::vector<uint8_t> data;
+        // Dsp-adpcm only, the block encoded from the source history and the contexts its captures belong to
+        BfstmSpeculativeBlock speculative;
+        std::vector<DSPAdpcmContext *> targets;
+    };
+
+    /**
+     * All channels of one block. The channels are encoded as independent tasks on the pool, the writer helps with the
+     * channels that were not started yet when it needs the block (like ThreadPool::parallelFor).
+     */
+    struct BlockJob {
+        uint32_t blockStart;
+        uint32_t sampleCount;
+        // Planar, blockSizeSamples per channel
+        std::vector<int16_t> samples;
+        // The source samples before the block for every channel, the speculative dsp-adpcm history
+        std::vector<BfstmHistoryInfo> sourceHistory;
+        std::vector<EncodedBlock> encoded;
+        std::atomic_uint32_t next = 0;
+        std::atomic_uint32_t done = 0;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+
+    struct ChannelState {
+        BfstmDSPADPCMChannelInfo channelInfo{};
+        std::vector<DSPAdpcmContext> regionContexts{};
+        EncodeMetrics metrics{};
+        // The real history after the last written block
+        int16_t yn1 = 0, yn2 = 0;
+    };
+
+    // Frames that are analyzed at once
+    constexpr uint32_t COEFFICIENT_CHUNK = 0x10000;
+
+    std::vector<BfstmDSPADPCMChannelInfo> calculateChannelInfos(const WavReader &reader,
+                                                                dspadpcm::EncodePreset preset) {
+        const WavInfo &info = reader.getInfo();
+        std::vector<dspadpcm::CoefficientBuilder> builders(info.channelNum, dspadpcm::CoefficientBuilder{preset});
+        std::vector<int16_t> buffer(static_cast<size_t>(COEFFICIENT_CHUNK) * info.channelNum);
+        std::vector<int16_t *> channels(info.channelNum);
+        for (uint32_t ch = 0; ch < info.channelNum; ++ch) {
+            channels[ch] = buffer.data() + static_cast<size_t>(ch) * COEFFICIENT_CHUNK;
+        }
+        ThreadPool pool{};
+        for (uint32_t start = 0; start < info.sampleCount; start += COEFFICIENT_CHUNK) {
+            uint32_t count = std::min(COEFFICIENT_CHUNK, info.sampleCount - start);
+            reader.readFrames(start, count, channels.data());
+            reader.release(start + count);
+            pool.parallelFor(info.channelNum, [&](uint32_t ch) {
+                builders[ch].add(channels[ch], count);
+            });
+        }
+        std::vector<BfstmDSPADPCMChannelInfo> channelInfos(info.channelNum);
+        pool.parallelFor(info.channelNum, [&](uint32_t ch) {
+            auto coefs = builders[ch].finish();
+            for (int i = 0; i < 8; ++i) {
+                channelInfos[ch].coefficients[i][0] = coefs[i * 2];
+                channelInfos[ch].coefficients[i][1] = coefs[i * 2 + 1];
+            }
+        });
+        return channelInfos;
+    }
+
+    void encodeBlock(const WavImportSettings &settings, const BfstmWriteInfo &writeInfo,
+                     std::span<const BfstmRegionInfo> regions, const BlockJob &job, uint32_t blockSizeSamples,
+                     uint32_t ch, ChannelState &state, EncodedBlock &encoded) {
+        const int16_t *pcm = job.samples.data() + static_cast<size_t>(ch) * blockSizeSamples;
+        switch (settings.encoding) {
+            case SoundEncoding::PCM8:
+                encoded.data.resize(job.sampleCount);
+                for (uint32_t i = 0; i < job.sampleCount; ++i) {
+                    encoded.data[i] = static_cast<uint8_t>(pcm[i] >> 8);
+                }
+                break;
+            case SoundEncoding::PCM16:
+                encoded.data.resize(job.sampleCount * sizeof(int16_t));
+                std::memcpy(encoded.data.data(), pcm, encoded.data.size());
+                break;
+            case SoundEncoding::DSP_ADPCM: {
+                encoded.data.resize(dspadpcm::getBytesForSamples(job.sampleCount));
+                std::optional<uint32_t> loopStart;
+                if (writeInfo.isLoop) loopStart = writeInfo.loopStart;
+                // Only the positions are read here, the writer fills in the contexts when reconciling
+                auto captures = getBfstmBlockCaptures(job.blockStart, job.sampleCount, state.channelInfo, loopStart,
+                                                      regions, state.regionContexts, encoded.targets);
+                encoded.speculative = encodeBfstmBlockSpeculative(pcm, job.sampleCount, encoded.data.data(),
+                                                                  job.sourceHistory[ch],
+                                                                  state.channelInfo.coefficients, settings.preset,
+                                                                  std::move(captures));
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // Encodes channels of the job until none are left, returns when the job is done
+    void runBlockJob(BlockJob &job, const std::function<void(uint32_t)> &encodeChannel) {
+        const auto count = static_cast<uint32_t>(job.encoded.size());
+        uint32_t ch;
+        while ((ch = job.next++) < count) {
+            encodeChannel(ch);
+            if (++job.done == count) {
+                std::lock_guard guard{job.mutex};
+                job.finished.notify_all();
+            }
+        }
+        std::unique_lock lock{job.mutex};
+        job.finished.wait(lock, [&job, count] { return job.done == count; });
+    }
+}
+
+bool importWav(std::ostream &out, const std::filesystem::path &wavPath, const std::filesystem::path &bfstmPath,
+               const WavImportSettings &settings) {
+    if (settings.encoding == SoundEncoding::IMA_ADPCM || settings.encoding > SoundEncoding::IMA_ADPCM) {
+        std::cerr << "Cannot import to " << settings.encoding << "!" << std::endl;
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    WavReader reader{wavPath};
+    if (!reader.success) return false;
+    const WavInfo &info = reader.getInfo();
+    if (info.channelNum > 0xFF) {
+        std::cerr << "Too many channels: " << info.channelNum << std::endl;
+        return false;
+    }
+    const uint32_t channelNum = info.channelNum;
+
+    BfstmWriteInfo writeInfo{settings.encoding, static_cast<uint8_t>(channelNum), info.loop.has_value(),
+                             info.sampleRate, info.loop ? info.loop->startSample : 0,
+                             info.loop ? info.loop->endSample : 0, info.sampleCount, settings.blockSizeBytes};
+    std::vector<ChannelState> states(channelNum);
+    if (settings.encoding == SoundEncoding::DSP_ADPCM) {
+        auto channelInfos = calculateChannelInfos(reader, settings.preset);
+        for (uint32_t ch = 0; ch < channelNum; ++ch) {
+            writeInfo.channelInfos.emplace_back(channelInfos[ch]);
+            states[ch].channelInfo = channelInfos[ch];
+        }
+    }
+    double coefficientSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ofstream file{bfstmPath, std::ios::binary};
+    if (!file) {
+        std::cerr << "Cannot open " << bfstmPath << std::endl;
+        return false;
+    }
+    BfstmWriter writer{file, writeInfo, settings.preset};
+    if (!writer.success) return false;
+    const uint32_t blockSizeSamples = writer.getBlockSizeSamples();
+    const uint32_t blockCount = (info.sampleCount + blockSizeSamples - 1) / blockSizeSamples;
+
+    std::vector<BfstmRegionInfo> regions;
+    for (const auto &[region, contexts]: writeInfo.regionInfos) {
+        regions.push_back(region);
+    }
+    for (auto &state: states) {
+        state.regionContexts.resize(regions.size());
+    }
+    auto encodeChannel = [&](BlockJob &job, uint32_t ch) {
+        encodeBlock(settings, writeInfo, regions, job, blockSizeSamples, ch, states[ch], job.encoded[ch]);
+    };
+    // Declared after everything the tasks use, its destructor runs the tasks that are left if writing failed
+    ThreadPool pool{};
+
+    // Enough blocks in flight that every worker has a channel to encode
+    uint32_t queueBlocks = std::max(settings.queueBlocks, (pool.getThreadCount() + channelNum - 1) / channelNum + 1);
+    BoundedQueue<std::shared_ptr<BlockJob>> jobs{queueBlocks};
+
+    std::thread readThread([&] {
+        std::vector<BfstmHistoryInfo> sourceHistory(channelNum);
+        for (uint32_t block = 0; block < blockCount; ++block) {
+            auto job = std::make_shared<BlockJob>();
+            job->blockStart = block * blockSizeSamples;
+            job->sampleCount = std::min(blockSizeSamples, info.sampleCount - job->blockStart);
+            job->samples.resize(static_cast<size_t>(blockSizeSamples) * channelNum);
+            job->encoded.resize(channelNum);
+            std::vector<int16_t *> channels(channelNum);
+            for (uint32_t ch = 0; ch < channelNum; ++ch) {
+                channels[ch] = job->samples.data() + static_cast<size_t>(ch) * blockSizeSamples;
+            }
+            reader.readFrames(job->blockStart, job->sampleCount, channels.data());
+            reader.release(job->blockStart);
+            job->sourceHistory = sourceHistory;
+            for (uint32_t ch = 0; ch < channelNum; ++ch) {
+                const int16_t *last = channels[ch] + job->sampleCount - 1;
+                sourceHistory[ch] = {last[0], job->sampleCount > 1 ? last[-1] : sourceHistory[ch].histSample1};
+            }
+            for (uint32_t ch = 0; ch < channelNum; ++ch) {
+                pool.submit([job, &encodeChannel] {
+                    runBlockJob(*job, [&](uint32_t ch) { encodeChannel(*job, ch); });
+                });
+            }
+            if (!jobs.push(std::move(job))) return;
+        }
+        jobs.close();
+    });
+
+    // Blocks are written in order, so the real dsp-adpcm history of every channel is known here and the speculative
+    // blocks are reconciled with it
+    bool success = true;
+    std::vector<const uint8_t *> channels(channelNum);
+    std::vector<BfstmHistoryInfo> history(channelNum);
+    for (uint32_t block = 0; block < blockCount && success; ++block) {
+        auto job = jobs.pop();
+        if (!job) {
+            std::cerr << "Block " << block << " is missing!" << std::endl;
+            success = false;
+            break;
+        }
+        runBlockJob(**job, [&](uint32_t ch) { encodeChannel(**job, ch); });
+        for (uint32_t ch = 0; ch < channelNum; ++ch) {
+            EncodedBlock &encoded = (*job)->encoded[ch];
+            channels[ch] = encoded.data.data();
+            if (settings.encoding != SoundEncoding::DSP_ADPCM) continue;
+            ChannelState &state = states[ch];
+            history[ch] = {state.yn1, state.yn2};
+            reconcileBfstmBlock((*job)->samples.data() + static_cast<size_t>(ch) * blockSizeSamples,
+                                (*job)->sampleCount, encoded.data.data(), state.yn1, state.yn2,
+                                state.channelInfo.coefficients, settings.preset, encoded.speculative, state.metrics);
+            applyBfstmBlockCaptures(encoded.speculative.captures, encoded.targets);
+        }
+        success = writer.writeEncodedBlock(channels.data(), (*job)->sampleCount, history.data());
+    }
+    if (!success) jobs.close();
+    readThread.join();
+    if (!success) return false;
+
+    if (settings.encoding == SoundEncoding::DSP_ADPCM) {
+        for (uint32_t ch = 0; ch < channelNum; ++ch) {
+            const ChannelState &state = states[ch];
+            writer.setDspContexts(ch, state.channelInfo.startContext, state.channelInfo.loopContext,
+                                  state.regionContexts);
+        }
+    }
+    if (!writer.finish()) return false;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double audioSeconds = info.sampleRate == 0 ? 0 : static_cast<double>(info.sampleCount) / info.sampleRate;
+    out << "Imported " << wavPath.string() << ": " << channelNum << " channels, " << info.sampleCount
+        << " samples, " << blockCount << " blocks in " << seconds << " s (" << audioSeconds / seconds
+        << "x realtime, coefficients " << coefficientSeconds << " s)" << std::endl;
+    if (settings.encoding == SoundEncoding::DSP_ADPCM) {
+        for (uint32_t ch = 0; ch < channelNum; ++ch) {
+            out << "  channel " << ch << ": snr " << states[ch].metrics.getSnr() << " dB" << std::endl;
+        }
+    }
+    return true;
+}
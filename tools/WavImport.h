@@ -0,0 +1,33 @@
+//
+// Created by cookieso on 19.10.26.
+//
+
+#pragma once
+
+#include <filesystem>
+#include <ostream>
+#include "../codec/DspADPCM.h"
+#include "../format/bfstm/BfstmFile.h"
+
+struct WavImportSettings {
+    // Pcm8, pcm16 or dsp-adpcm
+    SoundEncoding encoding = SoundEncoding::DSP_ADPCM;
+    dspadpcm::EncodePreset preset = dspadpcm::EncodePreset::BALANCED;
+    uint32_t blockSizeBytes = 0x2000;
+    // Blocks that may be in flight between the reader and the writer, raised if the pool needs more to stay busy
+    uint32_t queueBlocks = 4;
+};
+
+/**
+ * Converts a pcm16 wav to a bfstm in a pipeline. A reader deinterleaves blocks from the memory mapped wav and
+ * submits every channel of a block as a task to a thread pool, so all cores encode even for mono and stereo tracks.
+ * Dsp-adpcm blocks are encoded speculatively from the source history (see encodeBfstmBlockSpeculative) and reconciled
+ * by the calling thread, which writes the blocks in order. A bounded queue of blocks in flight keeps only a few blocks
+ * in memory however long the track is. Dsp-adpcm coefficients are calculated in a
+ * streaming pass over the mapping before, in parallel per channel. Only the analysis records of the coefficient
+ * search grow with the track (24 bytes per analyzed frame).
+ * The wav loop (smpl chunk) becomes the stream loop.
+ * @return true if the bfstm was written
+ */
+bool importWav(std::ostream &out, const std::filesystem::path &wavPath, const std::filesystem::path &bfstmPath,
+               const WavImportSettings &settings);